@@ -0,0 +1,63 @@
+#ifndef _ALIGNED_H
+#define _ALIGNED_H
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <utility>
+
+#include <cstdlib>
+
+// Heap objects and arrays of over-aligned types, e.g. alignas(64) to keep
+// them on cache lines of their own. Before C++17, new ignores any alignment
+// beyond alignof(max_align_t), so these go through posix_memalign().
+template <typename T>
+class AlignedDelete {
+  size_t n;
+
+public:
+  explicit AlignedDelete(size_t n = 1) : n(n) {}
+
+  void operator()(T *p) const {
+    for (size_t i = 0; i < n; ++i)
+      p[i].~T();
+    free(p);
+  }
+};
+
+template <typename T>
+using AlignedPtr = std::unique_ptr<T, AlignedDelete<T>>;
+
+template <typename T>
+using AlignedArray = std::unique_ptr<T[], AlignedDelete<T>>;
+
+template <typename T>
+T *aligned_storage_for(size_t n) {
+  void *p;
+  if (posix_memalign(&p, std::max(alignof(T), sizeof(void*)), std::max<size_t>(n, 1) * sizeof(T)))
+    throw std::bad_alloc();
+  return (T*)p;
+}
+
+// n value-initialized T
+template <typename T>
+AlignedArray<T> make_aligned_array(size_t n) {
+  T *p = aligned_storage_for<T>(n);
+  for (size_t i = 0; i < n; ++i)
+    new (p + i) T();
+  return AlignedArray<T>(p, AlignedDelete<T>(n));
+}
+
+template <typename T, typename... Args>
+AlignedPtr<T> make_aligned(Args&&... args) {
+  T *p = aligned_storage_for<T>(1);
+  try {
+    new (p) T(std::forward<Args>(args)...);
+  } catch (...) {
+    free(p);
+    throw;
+  }
+  return AlignedPtr<T>(p);
+}
+
+#endif
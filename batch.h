@@ -0,0 +1,68 @@
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#include <string>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "index.h"
+
+// A batch of single-block candidates in the SoA layout of the multi-buffer
+// hash kernels: word i of lane j lives at blocks[i * L + j]. Lanes that are
+// filled later only overwrite the words that differ between candidates, the
+// rest is laid out once with fill(). If prefix_words > 0, mids holds the
+// cached midstate of every lane (M words each). The lanes hold consecutive
+// candidates, starting with index first.
+template <size_t L, size_t M>
+struct Batch {
+  static const size_t lanes = L;
+
+  alignas(64) uint32_t blocks[16 * L];
+  alignas(64) uint32_t mids[M * L];
+  uint32_t lens[L];
+  size_t size;
+  int prefix_words;
+  index_t first;
+
+  Batch() : size(0), prefix_words(0), first(0) {}
+
+  // Lays out block in every lane
+  void fill(const uint32_t *block) {
+    for (size_t i = 0; i < 16; ++i)
+      for (size_t j = 0; j < L; ++j)
+        blocks[i * L + j] = block[i];
+  }
+
+  // Copies words lo..hi of block (and the midstate, if given) to the next lane
+  void add(const uint32_t *block, int lo, int hi, size_t len, const uint32_t *mid = nullptr) {
+    for (int i = lo; i <= hi; ++i)
+      blocks[i * L + size] = block[i];
+    if (mid) {
+      for (size_t i = 0; i < M; ++i)
+        mids[i * L + size] = mid[i];
+    }
+    lens[size++] = len;
+  }
+
+  bool full() const {
+    return size == L;
+  }
+
+  void clear() {
+    size = 0;
+  }
+
+  uint64_t lane_mask() const {
+    return size < 64 ? (uint64_t(1) << size) - 1 : ~uint64_t(0);
+  }
+
+  std::string candidate(size_t j) const {
+    uint32_t block[16];
+    for (size_t i = 0; i < 16; ++i)
+      block[i] = blocks[i * L + j];
+    return std::string((const char*)block, lens[j]);
+  }
+};
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef _CHECKPOINT_H
+#define _CHECKPOINT_H
+
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "intervals.h"
+#include "io.h"
+
+// Persistent record of a search's progress: the completed index intervals and
+// the matches found so far. save() writes a temporary file and renames it over
+// the old one, so a crash at any point leaves a consistent checkpoint behind.
+// Only one save() at a time writes the temporary file.
+class Checkpoint {
+  std::string fname;
+  std::string job; // identifies the search, restoring a different one fails
+  IntervalSet done;
+  std::vector<std::string> matches;
+  bool unsaved_matches; // whether there are matches since the last save()
+  mutable std::mutex mx, save_mx;
+
+public:
+  Checkpoint(const std::string& fname, const std::string& job)
+    : fname(fname), job(job), unsaved_matches(false) {}
+
+  const std::string& file_name() const {
+    return fname;
+  }
+
+  void load() {
+    std::ifstream f(fname);
+    std::string magic, line;
+    if (!f.good() || !getline(f, magic) || magic != "crhash-checkpoint 1")
+      throw IOException("Could not read checkpoint " + fname);
+    std::lock_guard<std::mutex> lg(mx);
+    while (getline(f, line)) {
+      std::istringstream in(line);
+      std::string kind, arg;
+      in >> kind;
+      if (kind == "job") {
+        if (!(in >> arg) || !is_hex(arg))
+          throw IOException("Corrupt job in checkpoint " + fname);
+        if (from_hex(arg) != job)
+          throw IOException("Checkpoint " + fname + " belongs to a different search");
+      } else if (kind == "done") {
+        index_t lo, hi;
+        if (!(in >> lo >> hi))
+          throw IOException("Corrupt interval in checkpoint " + fname);
+        done.add(lo, hi);
+      } else if (kind == "match") {
+        if (!(in >> arg) || !is_hex(arg))
+          throw IOException("Corrupt match in checkpoint " + fname);
+        matches.push_back(from_hex(arg));
+      }
+    }
+  }
+
+  void mark_done(index_t lo, index_t hi) {
+    std::lock_guard<std::mutex> lg(mx);
+    done.add(lo, hi);
+  }
+
+  void add_match(const std::string& s) {
+    std::lock_guard<std::mutex> lg(mx);
+    matches.push_back(s);
+    unsaved_matches = true;
+  }
+
+  // Whether a match was added since the last save()
+  bool dirty() const {
+    std::lock_guard<std::mutex> lg(mx);
+    return unsaved_matches;
+  }
+
+  IntervalSet completed() const {
+    std::lock_guard<std::mutex> lg(mx);
+    return done;
+  }
+
+  std::vector<std::string> found() const {
+    std::lock_guard<std::mutex> lg(mx);
+    return matches;
+  }
+
+  void save() {
+    std::lock_guard<std::mutex> save_lg(save_mx);
+    std::ostringstream out;
+    {
+      std::lock_guard<std::mutex> lg(mx);
+      unsaved_matches = false;
+      out << "crhash-checkpoint 1\n";
+      out << "job " << to_hex(job) << "\n";
+      for (auto& i : done.intervals())
+        out << "done " << i.first << " " << i.second << "\n";
+      for (auto& m : matches)
+        out << "match " << to_hex(m) << "\n";
+    }
+    std::string data = out.str(), tmp = fname + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      throw IOException("Could not write checkpoint " + tmp);
+    bool ok = write(fd, data.c_str(), data.size()) == (ssize_t)data.size();
+    ok = fsync(fd) == 0 && ok;
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), fname.c_str()) != 0)
+      throw IOException("Could not write checkpoint " + fname);
+  }
+};
+
+#endif
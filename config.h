@@ -1,4 +1,5 @@
 #include <random>
+#include <immintrin.h>
 #include "md5.h"
 
 #include "md5.cl.h"
@@ -24,6 +25,70 @@ void compute_hash(const unsigned char *data, size_t data_sz, unsigned char *res)
   md5_hash(data, data_sz, (uint32_t*)res);
 }
 
+// Single-block fast path: strings of at most max_block_len bytes are hashed
+// from a pre-padded block that every worker keeps around, patching only the
+// wildcard bytes between two candidates. Set to 0 to disable.
+const size_t max_block_len = 55;
+
+void prepare_block(uint32_t block[16], size_t len) {
+  md5_pad_block(block, len);
+}
+
+// Midstate caching on top of the single-block path: when the first
+// prefix_words words of the block stay constant for a whole sweep of the fastest
+// wildcards, the enumerator computes the state after the round-1 steps that
+// consume them once and resumes each compression in the batch from there.
+const size_t midstate_size = 4; // in words
+
+void compute_prefix(const uint32_t block[16], int prefix_words, uint32_t *mid) {
+  uint32_t state[4];
+  md5_init(state);
+  md5_round1_prefix(state, block, prefix_words, mid);
+}
+
+// Batch path: hashes batch_lanes single-block messages per call with the
+// multi-buffer kernels of md5_simd.cpp. blocks, mids and res use their SoA
+// layout, res receives hash_size / 4 words per lane that hold the digest
+// bytes in memory order.
+#if defined(__AVX512F__)
+const size_t batch_lanes = 16;
+#elif defined(__AVX2__)
+const size_t batch_lanes = 8;
+#else
+const size_t batch_lanes = 1;
+#endif
+
+void init_batch_state(uint32_t *res) {
+  uint32_t iv[4];
+  md5_init(iv);
+  for (size_t i = 0; i < 4; ++i)
+    for (size_t j = 0; j < batch_lanes; ++j)
+      res[i * batch_lanes + j] = iv[i];
+}
+
+void compute_hash_batch(const uint32_t *blocks, uint32_t *res) {
+  init_batch_state(res);
+#if defined(__AVX512F__)
+  md5_compress_x16(res, blocks);
+#elif defined(__AVX2__)
+  md5_compress_x8(res, blocks);
+#else
+  md5_compress(res, blocks);
+#endif
+}
+
+void compute_hash_batch_resume(const uint32_t *blocks, const uint32_t *mids, int prefix_words,
+                               uint32_t *res) {
+  init_batch_state(res);
+#if defined(__AVX512F__)
+  md5_compress_x16_resume(res, blocks, mids, prefix_words);
+#elif defined(__AVX2__)
+  md5_compress_x8_resume(res, blocks, mids, prefix_words);
+#else
+  md5_compress_resume(res, blocks, mids, prefix_words);
+#endif
+}
+
 bool check(unsigned char *hash) {
   if (hash[0] != 0x0e)
     return 0;
@@ -32,3 +97,49 @@ bool check(unsigned char *hash) {
       return 0;
   return 1;
 }
+
+// Batch version of check() over the digests that compute_hash_batch() left in
+// res. Returns a bitmask of the matching lanes. A nibble n is > 9 iff n + 6
+// carries into bit 4, which can be tested for all nibbles of a word at once.
+uint64_t check_batch(const uint32_t *res) {
+#if defined(__AVX512F__)
+  const __m512i nibbles = _mm512_set1_epi32(0x0f0f0f0f), six = _mm512_set1_epi32(0x06060606);
+  const __m512i *h = (const __m512i *)res;
+  __m512i w0 = _mm512_loadu_si512(h);
+  __mmask16 mask = _mm512_cmpeq_epi32_mask(
+      _mm512_and_si512(w0, _mm512_set1_epi32(0xff)), _mm512_set1_epi32(0x0e));
+  if (!mask)
+    return 0;
+  __m512i bad = _mm512_setzero_si512();
+  for (size_t i = 0; i < 4; ++i) {
+    __m512i w = i ? _mm512_loadu_si512(h + i) : _mm512_andnot_si512(_mm512_set1_epi32(0xff), w0);
+    __m512i lo = _mm512_add_epi32(_mm512_and_si512(w, nibbles), six);
+    __m512i hi = _mm512_add_epi32(_mm512_and_si512(_mm512_srli_epi32(w, 4), nibbles), six);
+    bad = _mm512_ternarylogic_epi32(bad, lo, hi, 0xfe);
+  }
+  return _mm512_mask_testn_epi32_mask(mask, bad, _mm512_set1_epi32(0x10101010));
+#elif defined(__AVX2__)
+  const __m256i nibbles = _mm256_set1_epi32(0x0f0f0f0f), six = _mm256_set1_epi32(0x06060606);
+  const __m256i *h = (const __m256i *)res;
+  __m256i w0 = _mm256_loadu_si256(h);
+  __m256i ok = _mm256_cmpeq_epi32(
+      _mm256_and_si256(w0, _mm256_set1_epi32(0xff)), _mm256_set1_epi32(0x0e));
+  if (_mm256_testz_si256(ok, ok))
+    return 0;
+  __m256i bad = _mm256_setzero_si256();
+  for (size_t i = 0; i < 4; ++i) {
+    __m256i w = i ? _mm256_loadu_si256(h + i) : _mm256_andnot_si256(_mm256_set1_epi32(0xff), w0);
+    __m256i lo = _mm256_add_epi32(_mm256_and_si256(w, nibbles), six);
+    __m256i hi = _mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(w, 4), nibbles), six);
+    bad = _mm256_or_si256(bad, _mm256_or_si256(lo, hi));
+  }
+  bad = _mm256_and_si256(bad, _mm256_set1_epi32(0x10101010));
+  ok = _mm256_andnot_si256(_mm256_cmpgt_epi32(bad, _mm256_setzero_si256()), ok);
+  return _mm256_movemask_ps(_mm256_castsi256_ps(ok));
+#else
+  uint32_t hash[4];
+  for (size_t i = 0; i < 4; ++i)
+    hash[i] = res[i * batch_lanes];
+  return check((unsigned char*)hash);
+#endif
+}
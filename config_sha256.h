@@ -0,0 +1,99 @@
+// Alternative configuration that cracks SHA-256 instead of MD5. Include it
+// from config.h instead of the MD5 definitions to use it.
+#include <random>
+#include "sha256.h"
+
+#define CAN_OPENCL 0
+
+const size_t hash_size = 32; // in bytes
+
+void compute_hash(const unsigned char *data, size_t data_sz, unsigned char *res) {
+  sha256_hash(data, data_sz, res);
+}
+
+// Single-block fast path, see config.h
+const size_t max_block_len = 55;
+
+void prepare_block(uint32_t block[16], size_t len) {
+  sha256_pad_block(block, len);
+}
+
+// Midstate caching, see config.h. Rounds 0..15 of SHA-256 consume the message
+// words in order just like round 1 of MD5.
+const size_t midstate_size = 8; // in words
+
+void compute_prefix(const uint32_t block[16], int prefix_words, uint32_t *mid) {
+  uint32_t state[8];
+  sha256_init(state);
+  sha256_round_prefix(state, block, prefix_words, mid);
+}
+
+// Batch path with the multi-buffer kernels of sha256_simd.cpp, see config.h.
+// The states are host-order words, so they are byte swapped into digest order.
+#if defined(__AVX512F__)
+const size_t batch_lanes = 16;
+#elif defined(__AVX2__)
+const size_t batch_lanes = 8;
+#else
+const size_t batch_lanes = 1;
+#endif
+
+void init_batch_state(uint32_t *res) {
+  uint32_t iv[8];
+  sha256_init(iv);
+  for (size_t i = 0; i < 8; ++i)
+    for (size_t j = 0; j < batch_lanes; ++j)
+      res[i * batch_lanes + j] = iv[i];
+}
+
+void finish_batch_state(uint32_t *res) {
+  for (size_t i = 0; i < 8 * batch_lanes; ++i)
+    res[i] = __builtin_bswap32(res[i]);
+}
+
+void compute_hash_batch(const uint32_t *blocks, uint32_t *res) {
+  init_batch_state(res);
+#if defined(__AVX512F__)
+  sha256_compress_x16(res, blocks);
+#elif defined(__AVX2__)
+  sha256_compress_x8(res, blocks);
+#else
+  sha256_compress(res, blocks);
+#endif
+  finish_batch_state(res);
+}
+
+void compute_hash_batch_resume(const uint32_t *blocks, const uint32_t *mids, int prefix_words,
+                               uint32_t *res) {
+  init_batch_state(res);
+#if defined(__AVX512F__)
+  sha256_compress_x16_resume(res, blocks, mids, prefix_words);
+#elif defined(__AVX2__)
+  sha256_compress_x8_resume(res, blocks, mids, prefix_words);
+#else
+  sha256_compress_resume(res, blocks, mids, prefix_words);
+#endif
+  finish_batch_state(res);
+}
+
+bool check(unsigned char *hash) {
+  if (hash[0] != 0x0e)
+    return 0;
+  for (int i = 1; i < hash_size; ++i)
+    if ((hash[i] & 0xf) > 9 || (hash[i]>>4) > 9)
+      return 0;
+  return 1;
+}
+
+// Batch version of check(), see config.h
+uint64_t check_batch(const uint32_t *res) {
+  uint64_t mask = 0;
+  for (size_t j = 0; j < batch_lanes; ++j) {
+    uint32_t hash[8];
+    for (size_t i = 0; i < 8; ++i)
+      hash[i] = res[i * batch_lanes + j];
+    if (check((unsigned char*)hash))
+      mask |= uint64_t(1) << j;
+  }
+  return mask;
+}
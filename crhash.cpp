@@ -1,17 +1,39 @@
+#include <algorithm>
 #include <atomic>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <set>
+#include <sstream>
 #include <thread>
 #include <vector>
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
+#include <csignal>
 #include <unistd.h>
 
+#include "aligned.h"
+#include "batch.h"
+#include "checkpoint.h"
+#include "intervals.h"
 #include "io.h"
+#include "keyspace.h"
+#include "leases.h"
+#include "markov.h"
+#include "masks.h"
+#include "net.h"
+#include "odometer.h"
+#include "progress.h"
+#include "rules.h"
+#include "scheduler.h"
+#include "spsc.h"
+#include "targets.h"
 #include "timing.h"
+#include "wordlist.h"
 #if HAVE_OPENCL
 #  include "opencl.h"
 #endif
@@ -20,7 +42,7 @@
 #include "config.h"
 using namespace std;
 
-void print_hex(unsigned char *data, size_t len) {
+void print_hex(const unsigned char *data, size_t len) {
   for (int i = 0; i < len; ++i)
     printf("%02x", data[i]);
 }
@@ -40,6 +62,18 @@ void print_repr_string(I a, I b) {
 
 // constants
 const int PROGRESS_INTERVAL = 200000; // msecs
+const double CHECKPOINT_INTERVAL = 10; // secs
+const double LEASE_TIMEOUT = 30; // secs without a heartbeat until a lease is reissued
+const double HEARTBEAT_INTERVAL = 5; // secs
+const double LEASE_DURATION = 10; // secs of work per lease, at the measured speed
+const size_t FIRST_LEASE = 1<<24; // strings per thread, before there is a speed
+const size_t MIN_PREFIX_SWEEP = 16; // strings per cached midstate, at least
+const size_t SCHEDULER_CHUNK = 1<<16; // strings per scheduled index range
+const size_t REPORT_QUEUE_SIZE = 1<<12; // reports in flight per thread
+const int REPORT_INTERVAL = 1000; // usecs the reporter sleeps when idle
+const size_t VERIFY_FIRST = 16; // matches to verify before sampling
+const size_t VERIFY_EVERY = 256; // verify every n-th match after that
+const double PREFILTER_MAX_RATE = 0.05; // share of candidates passing a useful prefilter
 
 // options
 string pattern;
@@ -50,161 +84,502 @@ bool compute_all = false;
 bool use_opencl = false;
 bool verify = true;
 
+index_t skip = 0;
+index_t limit = INDEX_MAX;
+size_t shard = 0, num_shards = 1;
+string checkpoint_file;
+bool restore = false;
+string serve_addr, worker_addr;
+string targets_file;
+int prefilter_bits = -1; // log2 of the bits of the prefilter, -1 for auto
+string build_index_file, output_file;
+string markov_file, train_markov_file;
+string wordlist_file;
+string rules_file;
+string masks_file;
+int increment_min = 0, increment_max = 0; // numbers of wildcards, 0 if not given
+
 vector<int> wildcard_positions;
+Keyspace keyspace; // of the whole pattern, or of the mask of a -w pattern
+MaskList masks; // the keyspaces that a run without -w goes through, in order
+Wordlist words; // of a -w run, whose candidate i is the pattern with word i
+RuleSet rules; // applied to every word, just the identity without -r
+MarkovModel markov; // orders the alphabets if not empty
+string word_prefix, word_suffix; // the parts of the pattern around the '*'
+int mask_split; // number of wildcards in front of the '*'
+index_t range_first, range_last; // the part of the keyspace to run
+RangeList pending; // the parts of the range that are not done yet
+ProgressCounters progress; // strings tested by this run, one slot per thread
+TargetTable<hash_size> targets; // if not empty, replaces check()
+atomic<bool> interrupted(false);
+unique_ptr<Connection> coordinator; // of a --worker
+string job_targets; // fingerprint of the coordinator's --targets, if any
+mutex coordinator_mx;
 
-template <typename T>
-void enumerate(int idx, string& pattern, size_t& progress, T cb) {
-  if (idx == wildcard_positions.size()) {
-    progress++;
-    if (progress % 2000000 == 0) {
-      cb(pattern, progress);
-      progress = 0;
-    } else {
-      cb(pattern, 0);
-    }
-    return;
+const string& alphabet_for(size_t idx) {
+  return idx < alphabets.size() ? alphabets[idx] : alphabets.back();
+}
+
+Odometer make_odometer(unsigned char *buf) {
+  return Odometer(buf, keyspace);
+}
+
+// The predicate that a match must pass: check() of the config, or being one
+// of the --targets
+bool passes(const unsigned char *hash) {
+  return targets.empty() ? check((unsigned char*)hash) : targets.contains(hash);
+}
+
+// Runs odo over the count candidates starting at index first. cb is called
+// once for every candidate with the index of the most significant wildcard
+// that changed since the last call, or -1 if they all might have.
+template <typename U>
+void enumerate(Odometer& odo, index_t first, size_t count, U cb) {
+  odo.seek(first);
+  int changed = -1;
+  for (size_t i = 0; i < count; ++i) {
+    cb(changed);
+    changed = odo.next();
   }
-  int p = wildcard_positions[idx];
-  const string& alphabet = idx < alphabets.size() ? alphabets[idx] : alphabets.back();
-  int alph_sz = alphabet.size();
-  if (idx == 0 && num_threads > 1) {
-    vector<thread> threads;
-    int first = 0;
-    for (int t = 0; t < num_threads; ++t) {
-      int last = first + alph_sz / num_threads + (t < alph_sz % num_threads) - 1;
-      if (verbose) {
-        cout << "  Thread " << t << " responsible for alphabet range "
-            << first << ".." << last << endl;
+}
+
+// Calls cb(first, last) for the pending keyspace intervals behind the virtual
+// ranges that sched assigns to worker t and counts them as progress of t
+template <typename F>
+void for_each_range(WorkStealingScheduler& sched, int t, F cb) {
+  index_t lo, hi;
+  while (sched.next(t, lo, hi)) {
+    pending.map(lo, hi, cb);
+    progress.add(t, hi - lo);
+  }
+}
+
+// Picks the trailing wildcards inner.. of ks that change in sweeps of at least
+// MIN_PREFIX_SWEEP strings. Returns the number of leading block words that stay
+// constant during such a sweep.
+int prefix_words_for_sweep(const Keyspace& ks, int& inner) {
+  inner = ks.num_wildcards() - 1;
+  size_t sweep = ks.base(inner);
+  while (inner > 0 && sweep < MIN_PREFIX_SWEEP)
+    sweep *= ks.base(--inner);
+  return ks.position(inner) / 4;
+}
+
+typedef Batch<batch_lanes, midstate_size> CandidateBatch;
+
+// Calls cb(i, first, last) for the parts of the ranges that sched assigns to
+// worker t, with first and last relative to mask i, and cb_done(t, first,
+// last) after every range
+template <typename T, typename F>
+void for_each_mask_range(WorkStealingScheduler& sched, int t, T cb_done, F cb) {
+  for_each_range(sched, t, [&](index_t first, index_t last) {
+    masks.split(first, last, cb);
+    cb_done(t, first, last);
+  });
+}
+
+// Fills batches with the single-block candidates of ks and hands every one of
+// them to a backend. The lanes share the constant words of the block, which
+// is laid out and padded for the length of ks, so every candidate only copies
+// the words that hold wildcards. A worker keeps one for the mask it is on, so
+// the block, odometer and batch carry over from one range to the next and
+// only the midstate is recomputed after the seek.
+class MaskBatcher {
+  const Keyspace& ks;
+  size_t len;
+  uint32_t block[16];
+  Odometer odo;
+  int inner, prefix_words, lo, hi;
+  uint32_t mid[midstate_size];
+  CandidateBatch batch;
+
+  // Lays out the pattern of ks in block, padded for its length
+  static unsigned char *layout(const Keyspace& ks, uint32_t *block) {
+    copy(begin(ks.pattern()), end(ks.pattern()), (unsigned char*)block);
+    prepare_block(block, ks.pattern().size());
+    return (unsigned char*)block;
+  }
+
+public:
+  explicit MaskBatcher(const Keyspace& ks)
+    : ks(ks), len(ks.pattern().size()), odo(layout(ks, block), ks)
+    , prefix_words(prefix_words_for_sweep(ks, inner))
+    , lo(ks.position(0) / 4), hi(ks.position(ks.num_wildcards() - 1) / 4)
+  {
+    batch.fill(block);
+    batch.prefix_words = prefix_words;
+  }
+
+  const Keyspace& keyspace() const {
+    return ks;
+  }
+
+  // Runs the candidates [first, last) of ks, whose indices start at base.
+  // The last batch is handed on partly filled, so that the range is done
+  // when this returns.
+  template <typename B>
+  void run(index_t base, index_t first, index_t last, B backend) {
+    index_t index = base + first;
+    enumerate(odo, first, last - first, [&](int changed) {
+      if (prefix_words > 0 && changed < inner)
+        compute_prefix(block, prefix_words, mid);
+      if (!batch.size)
+        batch.first = index;
+      batch.add(block, lo, hi, len, prefix_words > 0 ? mid : nullptr);
+      index++;
+      if (batch.full()) {
+        backend(batch);
+        batch.clear();
       }
-      threads.emplace_back([=]() {
-        string local_pattern = pattern;
-        size_t local_progress = 0;
-        for (int i = first; i <= last; ++i) {
-          local_pattern[p] = alphabet[i];
-          enumerate(idx + 1, local_pattern, local_progress, cb);
+    });
+    if (batch.size) {
+      backend(batch);
+      batch.clear();
+    }
+  }
+};
+
+// Default batch backend: hashes a batch with the kernels of the config and
+// calls cb_match(candidate, digest, index) for the lanes that pass
+// check_batch(), or that hold one of the targets.
+template <typename U>
+void hash_batch(const CandidateBatch& batch, U cb_match) {
+  alignas(64) uint32_t res[hash_size / 4 * batch_lanes];
+  if (batch.prefix_words > 0)
+    compute_hash_batch_resume(batch.blocks, batch.mids, batch.prefix_words, res);
+  else
+    compute_hash_batch(batch.blocks, res);
+  uint64_t matches = targets.empty() ? check_batch(res) : targets.match_batch<batch_lanes>(res);
+  matches &= batch.lane_mask();
+  while (matches) {
+    int j = __builtin_ctzll(matches);
+    matches &= matches - 1;
+    unsigned char digest[hash_size];
+    for (size_t i = 0; i < hash_size / 4; ++i)
+      memcpy(digest + 4 * i, &res[i * batch_lanes + j], 4);
+    cb_match(batch.candidate(j), digest, batch.first + j);
+  }
+}
+
+// The wildcards of the mask from mask_split on follow the '*' of a wordlist
+// pattern, so they move with the length of the word
+size_t mask_position(int i, size_t len) {
+  return keyspace.position(i) + (i >= mask_split ? len : 0);
+}
+
+// Number of leading block words in front of both the word and the mask of a
+// wordlist pattern, which never change
+int fixed_words_for_words() {
+  size_t fixed = word_prefix.size();
+  if (keyspace.num_wildcards() > 0)
+    fixed = min(fixed, mask_position(0, 0));
+  return fixed / 4;
+}
+
+// Wordlist counterpart of prefix_words_for_sweep() for a word of length len.
+// inner is -1 if even the whole mask makes a shorter sweep, which then spans
+// several words and only keeps the fixed words constant.
+int word_prefix_words_for_sweep(size_t len, int& inner) {
+  size_t sweep = 1;
+  inner = keyspace.num_wildcards();
+  while (inner > 0 && sweep < MIN_PREFIX_SWEEP)
+    sweep *= keyspace.base(--inner);
+  if (sweep >= MIN_PREFIX_SWEEP)
+    return mask_position(inner, len) / 4;
+  inner = -1;
+  return fixed_words_for_words();
+}
+
+// Room for a word after the rules are applied to it
+size_t word_room() {
+  return max(words.max_length(), RuleSet::MAX_LEN);
+}
+
+// Calls cb(len, changed, index) for the candidates of the ranges that sched
+// assigns to worker t and cb_done(t, first, last) after every range. With R
+// rules and a mask of M strings, candidate index is the pattern with its '*'
+// replaced by word index / (R * M) after rule index / M % R, and its mask
+// wildcards by the digits of index % M. It is built in s, which already holds
+// word_prefix and has word_room() after it, by copying the word straight from
+// the mapped wordlist, mangling it in place and then only rewriting the
+// wildcards that changed. changed is the index of the most significant one,
+// or -1 for the first candidate of a mangled word.
+template <typename T, typename U>
+void enumerate_words(WorkStealingScheduler& sched, int t, unsigned char *s, T cb_done, U cb) {
+  size_t offset = word_prefix.size(), room = word_room();
+  index_t mask_size = keyspace.size(), num_rules = rules.size();
+  Odometer odo = make_odometer(s);
+  for_each_range(sched, t, [&](index_t first, index_t last) {
+    const char *p = words.seek(first / mask_size / num_rules), *word;
+    size_t len;
+    size_t r = first / mask_size % num_rules;
+    index_t m = first % mask_size;
+    for (index_t index = first; index < last; r = 0) {
+      Wordlist::next(p, words.end(), word, len);
+      for (; r < num_rules && index < last; ++r, m = 0) {
+        memcpy(s + offset, word, len);
+        size_t mangled = rules.apply(r, s + offset, len, room);
+        memcpy(s + offset + mangled, word_suffix.data(), word_suffix.size());
+        odo.shift(mask_split, mangled);
+        odo.seek(m);
+        size_t n = offset + mangled + word_suffix.size();
+        int changed = -1;
+        for (; m < mask_size && index < last; ++m, ++index) {
+          cb(n, changed, index);
+          changed = odo.next();
         }
-      });
-      first = last + 1;
+      }
     }
-    for (auto& t : threads)
-      t.join();
-  } else {
-    for (int i = 0; i < alph_sz; ++i) {
-      pattern[p] = alphabet[i];
-      enumerate(idx + 1, pattern, progress, cb);
+    cb_done(t, first, last);
+  });
+}
+
+// Wordlist counterpart of MaskBatcher over the candidates that
+// enumerate_words() builds in block. The block words in front of the
+// wildcards that change during a sweep get a midstate, so with a mask every
+// word is only hashed once, and without one the pattern prefix is. Lanes share
+// the number of such words, so a batch is handed on early when it changes
+// with the length of the word. Candidates that do not fit into a single block
+// go to cb_long(len, index) instead, after the batch so far, which keeps the
+// lanes of a batch consecutive.
+template <typename T, typename B, typename V>
+void enumerate_word_batches(WorkStealingScheduler& sched, int t, uint32_t *block,
+                            T cb_done, B backend, V cb_long) {
+  int inner = -1;
+  int fixed_words = fixed_words_for_words();
+  uint32_t mid[midstate_size];
+  bool have_mid = false;
+  CandidateBatch batch;
+  batch.fill(block);
+  auto flush = [&]() {
+    if (batch.size) {
+      backend(batch);
+      batch.clear();
+    }
+  };
+  enumerate_words(sched, t, (unsigned char*)block, [&](int t, index_t first, index_t last) {
+    flush();
+    cb_done(t, first, last);
+  }, [&](size_t n, int changed, index_t index) {
+    if (n > max_block_len) {
+      flush();
+      cb_long(n, index);
+      return;
     }
+    if (changed < 0) {
+      prepare_block(block, n);
+      int prefix_words = word_prefix_words_for_sweep(n - pattern.size() + 1, inner);
+      if (prefix_words != batch.prefix_words) {
+        flush();
+        batch.prefix_words = prefix_words;
+        have_mid = false;
+      }
+    }
+    if (batch.prefix_words > 0 && (!have_mid || changed < inner)) {
+      compute_prefix(block, batch.prefix_words, mid);
+      have_mid = true;
+    }
+    if (!batch.size)
+      batch.first = index;
+    batch.add(block, fixed_words, 15, n, batch.prefix_words > 0 ? mid : nullptr);
+    if (batch.full())
+      flush();
+  });
+}
+
+template <typename T, typename U>
+void run_word_worker(WorkStealingScheduler& sched, int t, T cb_done, U cb_match) {
+  vector<uint32_t> buf(max<size_t>(16, (pattern.size() + word_room() + 3) / 4));
+  unsigned char *s = (unsigned char*)buf.data();
+  copy(begin(word_prefix), end(word_prefix), s);
+  unsigned char hash[hash_size];
+  auto hash_one = [&](size_t n, index_t index) {
+    compute_hash(s, n, hash);
+    if (passes(hash))
+      cb_match(t, string(s, s + n), hash, index);
+  };
+  if (pattern.size() - 1 <= max_block_len) {
+    enumerate_word_batches(sched, t, buf.data(), cb_done, [&](const CandidateBatch& batch) {
+      hash_batch(batch, [&](const string& s, const unsigned char *digest, index_t index) {
+        cb_match(t, s, digest, index);
+      });
+    }, hash_one);
+  } else {
+    enumerate_words(sched, t, s, cb_done, [&](size_t n, int, index_t index) {
+      hash_one(n, index);
+    });
   }
 }
 
 template <typename T, typename U>
-void run_cpu(T cb_progress, U cb_match) {
-  size_t local_progress = 0;
-  enumerate(0, pattern, local_progress, [&](const string& s, size_t add_progress) {
-    cb_progress(add_progress);
-    unsigned char hash[hash_size];
-    compute_hash((const unsigned char*)s.c_str(), s.size(), hash);
-    if (check(hash)) {
-      cb_match(s);
+void run_worker(WorkStealingScheduler& sched, int t, T cb_done, U cb_match) {
+  if (!wordlist_file.empty()) {
+    run_word_worker(sched, t, cb_done, cb_match);
+    return;
+  }
+  unsigned char hash[hash_size];
+  AlignedPtr<MaskBatcher> batcher;
+  for_each_mask_range(sched, t, cb_done, [&](size_t i, index_t first, index_t last) {
+    const Keyspace& ks = masks[i];
+    size_t len = ks.pattern().size();
+    if (len <= max_block_len) {
+      if (!batcher || &batcher->keyspace() != &ks)
+        batcher = make_aligned<MaskBatcher>(ks);
+      batcher->run(masks.first(i), first, last, [&](const CandidateBatch& batch) {
+        hash_batch(batch, [&](const string& s, const unsigned char *digest, index_t index) {
+          cb_match(t, s, digest, index);
+        });
+      });
+      return;
     }
+    vector<unsigned char> buf(begin(ks.pattern()), end(ks.pattern()));
+    unsigned char *s = buf.data();
+    Odometer odo(s, ks);
+    index_t index = masks.first(i) + first;
+    enumerate(odo, first, last - first, [&](int) {
+      compute_hash(s, len, hash);
+      if (passes(hash))
+        cb_match(t, string(s, s + len), hash, index);
+      index++;
+    });
   });
 }
 
+template <typename T, typename U>
+void run_cpu(T cb_done, U cb_match) {
+  // The scheduler splits the pending intervals as one virtual range
+  WorkStealingScheduler sched(0, pending.size(), num_threads, SCHEDULER_CHUNK);
+  // Print the initial shares before the first worker can steal from them
+  if (verbose && sched.workers() > 1 && pending.intervals().size() == 1 && !coordinator) {
+    index_t first = pending.intervals()[0].first;
+    for (int t = 0; t < sched.workers(); ++t) {
+      cout << "  Thread " << t << " starts with index range ["
+          << first + sched.initial_lo(t) << ", " << first + sched.initial_hi(t) << ")" << endl;
+    }
+  }
+  vector<thread> threads;
+  for (int t = 0; t < sched.workers(); ++t) {
+    threads.emplace_back([&, t]() {
+      run_worker(sched, t, cb_done, cb_match);
+    });
+  }
+  for (auto& t : threads)
+    t.join();
+}
+
 #if HAVE_OPENCL && CAN_OPENCL
 class CLBruteForceApp {
   OpenCLApp app;
   cl::Kernel kernel;
+  const Keyspace *keyspace;
   string prefix, suffix;
   int lo, hi;
   size_t pattern_size;
   size_t chunk_size;
   cl::Buffer buf_prefix, buf_suffix, buf_results;
   cl::Buffer buf_debug;
+  // The kernel takes 64-bit offsets, so it only enumerates the last
+  // low_wildcards wildcards. The leading ones are fixed to the digits of
+  // high_index as part of the prefix.
+  size_t low_wildcards;
+  index_t low_size;
+  index_t high_index;
+  string high_prefix; // stays alive for the asynchronous write
 
-  string generate(size_t id) {
-    string s = prefix;
-    size_t num = id;
-    size_t base = hi - lo + 1;
-    for (int i = 0; i < pattern_size; ++i) {
-      s += lo + num % base;
-      num /= base;
-    }
-    s += suffix;
-    return s;
+  string generate(index_t id) {
+    return keyspace->decode(id);
+  }
+
+  void set_high_index(index_t high) {
+    string s = keyspace->decode(high * low_size);
+    high_prefix = s.substr(0, prefix.size() + pattern_size - low_wildcards);
+    app.write_async(buf_prefix, high_prefix.c_str(), high_prefix.size());
+    kernel.setArg(1, (cl_uint)high_prefix.size());
+    high_index = high;
   }
 
   void prepare() {
-    buf_prefix = app.alloc<cl_uint>((prefix.size() + 3) / 4, CL_MEM_READ_ONLY);
+    low_wildcards = 0;
+    low_size = 1;
+    size_t base = hi - lo + 1;
+    while (low_wildcards < pattern_size && low_size * base <= (cl_ulong)-1) {
+      low_size *= base;
+      low_wildcards++;
+    }
+    buf_prefix = app.alloc<cl_uint>((prefix.size() + pattern_size + 3) / 4, CL_MEM_READ_ONLY);
     buf_suffix = app.alloc<cl_uint>((suffix.size() + 3) / 4, CL_MEM_READ_ONLY);
-    buf_results = app.alloc<cl_uchar>(chunk_size, CL_MEM_WRITE_ONLY);
-    //buf_debug = app.alloc<cl_uint>(16 * chunk_size, CL_MEM_WRITE_ONLY);
-    app.write_async(buf_prefix, prefix.c_str(), prefix.size());
     app.write_async(buf_suffix, suffix.c_str(), suffix.size());
     kernel.setArg(0, buf_prefix);
-    kernel.setArg(1, (cl_uint)prefix.size());
     kernel.setArg(2, buf_suffix);
     kernel.setArg(3, (cl_uint)suffix.size());
     kernel.setArg(4, (cl_uint)lo);
     kernel.setArg(5, (cl_uint)hi);
-    kernel.setArg(6, (cl_uint)pattern_size);
-    kernel.setArg(8, buf_results);
-    //kernel.setArg(9, buf_debug);
+    kernel.setArg(6, (cl_uint)low_wildcards);
+    set_high_index(0);
   }
 
+  // Runs the kernel on the chunk starting at index offset and reports the
+  // matches among its first count strings. The chunk must not cross a
+  // multiple of low_size.
   template <typename t>
-  void run_group(size_t offset, t cb) {
-    kernel.setArg(7, (cl_uint)offset);
+  void run_group(index_t offset, size_t count, t cb) {
+    if (offset / low_size != high_index)
+      set_high_index(offset / low_size);
+    kernel.setArg(7, (cl_ulong)(offset % low_size));
     assert(chunk_size % 256 == 0);
-    app.run_kernel(kernel, cl::NDRange(chunk_size), cl::NDRange(256));
+    app.run_kernel(kernel, cl::NDRange((count + 255) / 256 * 256), cl::NDRange(256));
     // TODO use vector
     cl_uchar *results = new cl_uchar[chunk_size];
     //char *debug = new char[64 * chunk_size];
     //app.read_sync(buf_debug, debug, chunk_size * 16);
     app.read_sync(buf_results, results, chunk_size);
-    for (int i = 0; i < chunk_size; ++i) {
+    for (size_t i = 0; i < count; ++i) {
       if (results[i]) {
         string s = generate(offset + i);
-        cb(s);
+        unsigned char digest[hash_size];
+        compute_hash((const unsigned char*)s.c_str(), s.size(), digest);
+        cb(s, digest, offset + i);
       }
     }
     delete[] results;
   }
 
 public:
-  CLBruteForceApp(
-      string kernel_source,
-      string kernel_name,
-      string prefix, string suffix,
-      int lo, int hi,
-      size_t pattern_size,
-      size_t chunk_size)
-    : app(), prefix(prefix), suffix(suffix), lo(lo), hi(hi)
-    , pattern_size(pattern_size), chunk_size(chunk_size)
+  CLBruteForceApp(string kernel_source, string kernel_name, size_t chunk_size)
+    : app(), keyspace(nullptr), chunk_size(chunk_size)
   {
     cl::Program prog = app.build_program(kernel_source);
     kernel = app.get_kernel(prog, kernel_name);
-    if (prefix.size() + suffix.size() + pattern_size > 55) {
-      cerr << "Only one-block messages supported with OpenCL, so the resulting strings "
-        << "must be <= 55 bytes long" << endl;
-      exit(1);
-    }
+    buf_results = app.alloc<cl_uchar>(chunk_size, CL_MEM_WRITE_ONLY);
+    //buf_debug = app.alloc<cl_uint>(16 * chunk_size, CL_MEM_WRITE_ONLY);
+    kernel.setArg(8, buf_results);
+    //kernel.setArg(9, buf_debug);
+  }
+
+  // Points the kernel at keyspace, whose pattern_size contiguous wildcards
+  // over the characters lo..hi are between prefix and suffix. The context
+  // and the compiled kernel stay, so switching between the masks of a run
+  // only uploads the new prefix and suffix.
+  void select(const Keyspace& keyspace, string prefix, string suffix,
+              int lo, int hi, size_t pattern_size) {
+    this->keyspace = &keyspace;
+    this->prefix = prefix;
+    this->suffix = suffix;
+    this->lo = lo;
+    this->hi = hi;
+    this->pattern_size = pattern_size;
     prepare();
   }
 
+  // Tests the candidates with indices in [first, last)
   template <typename T, typename U>
-  void run(T cb_progress, U cb_match) {
-    size_t total = 1, base = hi - lo + 1;
-    for (int i = 0; i < pattern_size; ++i) {
-      size_t new_total = total * base;
-      if (new_total / base != total) {
-        cerr << "Overflow when computing total number of possibilities, use less "
-                "wildcards or smaller alphabets!" << endl;
-        exit(1);
-      }
-      total = new_total;
-    }
-    for (size_t offset = 0; offset < total; offset += chunk_size) {
-      run_group(offset, cb_match);
-      cb_progress(min(chunk_size, total - offset));
+  void run(index_t first, index_t last, T cb_done, U cb_match) {
+    for (index_t offset = first; offset < last; ) {
+      size_t count = min<index_t>(min<index_t>(chunk_size, last - offset),
+                                  low_size - offset % low_size);
+      run_group(offset, count, cb_match);
+      cb_done(offset, offset + count);
+      offset += count;
     }
   }
 
@@ -221,60 +596,301 @@ bool is_contiguous(I a, I b) {
   return true;
 }
 
-template <typename T, typename U>
-void run_gpu(T cb_progress, U cb_match) {
-  if (!is_contiguous(begin(wildcard_positions), end(wildcard_positions))) {
+// Exits unless the kernel can enumerate ks
+void check_cl_support(const Keyspace& ks) {
+  vector<int> positions;
+  for (int i = 0; i < ks.num_wildcards(); ++i)
+    positions.push_back(ks.position(i));
+  if (!is_contiguous(begin(positions), end(positions))) {
     cerr << "Pattern not yet supported with OpenCL. Wildcards need to be contiguous" << endl;
     exit(1);
   }
-  if (alphabets.size() > 1) {
-    cerr << "Multiple alphabets not yet supported with OpenCL" << endl;
-    exit(1);
+  const string& alph = ks.alphabet(0);
+  for (int i = 1; i < ks.num_wildcards(); ++i) {
+    if (ks.alphabet(i) != alph) {
+      cerr << "Multiple alphabets not yet supported with OpenCL" << endl;
+      exit(1);
+    }
   }
-  for (int i = 1; i < alphabets[0].size(); ++i) {
-    if ((unsigned char)alphabets[0][i-1] + 1 != (unsigned char)alphabets[0][i]) {
+  for (int i = 1; i < alph.size(); ++i) {
+    if ((unsigned char)alph[i-1] + 1 != (unsigned char)alph[i]) {
       cerr << "Alphabet not yet supported with OpenCL. Characters need to be contiguous" << endl;
-      cerr << "Non-contiguous characters detected: " << alphabets[0][i-1] << " -> " << alphabets[0][i] << endl;
+      cerr << "Non-contiguous characters detected: " << alph[i-1] << " -> " << alph[i] << endl;
       exit(1);
     }
   }
-  string prefix = pattern.substr(0, wildcard_positions[0]);
-  string suffix = pattern.substr(wildcard_positions.back() + 1);
-  size_t pattern_len = wildcard_positions.back() - wildcard_positions[0] + 1;
-  int lo = (unsigned char)alphabets[0][0], hi = (unsigned char)alphabets[0].back();
-  CLBruteForceApp app(
-      cl_kernel_source, cl_kernel_name,
-      prefix, suffix,
-      lo, hi,
-      pattern_len,
-      cl_chunk_size
-  );
-  if (verbose)
-    app.print_cl_info();
-  app.run(cb_progress, cb_match);
+  if (ks.pattern().size() > 55) {
+    cerr << "Only one-block messages supported with OpenCL, so the resulting strings "
+      << "must be <= 55 bytes long" << endl;
+    exit(1);
+  }
+}
+
+// The OpenCL app, built on first use and kept around for the ranges that
+// follow, pointed at mask i
+CLBruteForceApp& cl_app(size_t i) {
+  static unique_ptr<CLBruteForceApp> app;
+  static size_t selected;
+  if (!app) {
+    // Fail before the first mask runs, not halfway through
+    for (size_t j = 0; j < masks.count(); ++j)
+      check_cl_support(masks[j]);
+    app.reset(new CLBruteForceApp(cl_kernel_source, cl_kernel_name, cl_chunk_size));
+    if (verbose)
+      app->print_cl_info();
+    selected = masks.count();
+  }
+  if (selected != i) {
+    const Keyspace& ks = masks[i];
+    int first = ks.position(0), last = ks.position(ks.num_wildcards() - 1);
+    const string& alph = ks.alphabet(0);
+    app->select(ks, ks.pattern().substr(0, first), ks.pattern().substr(last + 1),
+                (unsigned char)alph[0], (unsigned char)alph.back(), last - first + 1);
+    selected = i;
+  }
+  return *app;
+}
+
+template <typename T, typename U>
+void run_gpu(T cb_done, U cb_match) {
+  for (auto& r : pending.intervals()) {
+    masks.split(r.first, r.second, [&](size_t i, index_t first, index_t last) {
+      index_t base = masks.first(i);
+      cl_app(i).run(first, last, [&](index_t first, index_t last) {
+        progress.add(0, last - first);
+        cb_done(0, base + first, base + last);
+      }, [&](const string& s, const unsigned char *digest, index_t index) {
+        cb_match(0, s, digest, base + index);
+      });
+    });
+  }
 }
 #else // HAVE_OPENCL && CAN_OPENCL
 template <typename T, typename U>
-void run_gpu(T cb_progress, U cb_match) {
+void run_gpu(T cb_done, U cb_match) {
   cerr << "OpenCL not supported on your machine." << endl;
   exit(1);
 }
 #endif
 
 template <typename T, typename U>
-void run(T cb_progress, U cb_match) {
+void run(T cb_done, U cb_match) {
   if (use_opencl)
-    run_gpu(cb_progress, cb_match);
+    run_gpu(cb_done, cb_match);
   else
-    run_cpu(cb_progress, cb_match);
+    run_cpu(cb_done, cb_match);
+}
+
+// Coordinator: leases the pending intervals of the range to --worker processes
+// that connect to serve_addr and feeds what they report to cb_done and
+// cb_match, as thread 0. Returns once the whole range is done.
+template <typename T, typename U>
+void serve(T cb_done, U cb_match) {
+  int lfd;
+  try {
+    lfd = listen_on(serve_addr);
+  } catch (const IOException& e) {
+    cerr << e.what() << endl;
+    exit(1);
+  }
+  IntervalSet done;
+  index_t lo = range_first;
+  for (auto& r : pending.intervals()) {
+    done.add(lo, r.first);
+    lo = r.second;
+  }
+  done.add(lo, range_last);
+  LeaseTable table(range_first, range_last, done, LEASE_TIMEOUT);
+  mutex mx;
+  set<int> clients;
+  set<string> matches; // a reissued lease can report a match again
+  vector<thread> threads;
+  auto handle = [&](int fd) {
+    {
+      Connection conn(fd);
+      string line;
+      try {
+        while (conn.recv_line(line)) {
+          istringstream in(line);
+          string cmd, arg;
+          size_t id, count;
+          index_t lo, hi;
+          in >> cmd;
+          if (cmd == "hello") {
+            string job = "job " + to_hex(pattern);
+            for (auto& alph : alphabets)
+              job += " " + to_hex(alph);
+            // The list itself may be huge, workers load their own copy
+            if (!targets.empty())
+              job += " targets " + to_string(targets.fingerprint());
+            conn.send_line(job);
+          } else if (cmd == "lease" && in >> count) {
+            lock_guard<mutex> lg(mx);
+            if (table.finished())
+              conn.send_line("done");
+            else if (table.grant(count, util::get_time(), id, lo, hi))
+              conn.send_line("range " + to_string(id) + " " + index_str(lo) + " " + index_str(hi));
+            else
+              conn.send_line("wait");
+          } else if (cmd == "heartbeat" && in >> id) {
+            lock_guard<mutex> lg(mx);
+            conn.send_line(table.renew(id, util::get_time()) ? "ok" : "expired");
+          } else if (cmd == "complete" && in >> id >> lo >> hi) {
+            lock_guard<mutex> lg(mx);
+            // mx makes this thread the only writer of slot 0
+            for (auto& i : table.complete(id, lo, hi)) {
+              progress.add(0, i.second - i.first);
+              cb_done(0, i.first, i.second);
+            }
+            conn.send_line("ok");
+          } else if (cmd == "match" && in >> arg && is_hex(arg)) {
+            lock_guard<mutex> lg(mx);
+            string s = from_hex(arg);
+            unsigned char digest[hash_size];
+            index_t index;
+            if (matches.insert(arg).second && masks.encode(s, index)) {
+              compute_hash((const unsigned char*)s.c_str(), s.size(), digest);
+              // A worker with other targets or a broken build is not trusted
+              if (passes(digest))
+                cb_match(0, s, digest, index);
+              else
+                cerr << "Dropped a false match from a worker: " << arg << endl;
+            }
+            conn.send_line("ok");
+          } else {
+            conn.send_line("error");
+          }
+        }
+      } catch (const IOException&) {
+      }
+      lock_guard<mutex> lg(mx);
+      clients.erase(fd);
+    }
+  };
+  for (;;) {
+    {
+      lock_guard<mutex> lg(mx);
+      if (table.finished())
+        break;
+    }
+    int fd = accept_on(lfd, PROGRESS_INTERVAL / 1000);
+    if (fd < 0)
+      continue;
+    lock_guard<mutex> lg(mx);
+    clients.insert(fd);
+    threads.emplace_back(handle, fd);
+  }
+  close(lfd);
+  // Workers take the closed connection as the end of the search
+  {
+    lock_guard<mutex> lg(mx);
+    for (int fd : clients)
+      shutdown(fd, SHUT_RDWR);
+  }
+  for (auto& t : threads)
+    t.join();
+}
+
+// Sends a request to the coordinator and returns its reply. Exits when the
+// coordinator is gone, which is how it ends the search.
+string ask_coordinator(const string& request) {
+  lock_guard<mutex> lg(coordinator_mx);
+  string reply;
+  try {
+    coordinator->send_line(request);
+    if (coordinator->recv_line(reply))
+      return reply;
+  } catch (const IOException&) {
+  }
+  if (verbose)
+    cout << endl << "Coordinator closed the connection" << endl;
+  exit(0);
+}
+
+// Worker: runs the ranges that the coordinator leases until there are none
+// left. Every lease is sized to take about LEASE_DURATION at the speed of the
+// previous one, so every worker pulls work at its own rate. wait_reported()
+// returns once the matches found so far went to the coordinator, which must
+// have them before the range that they are in is complete.
+template <typename T, typename U, typename W>
+void work(T cb_done, U cb_match, W wait_reported) {
+  size_t count = FIRST_LEASE * num_threads;
+  atomic<long long> lease(-1);
+  atomic<bool> stopped(false);
+  thread heartbeat([&]() {
+    double last = util::get_time();
+    while (!stopped) {
+      usleep(PROGRESS_INTERVAL);
+      if (util::get_time() - last >= HEARTBEAT_INTERVAL) {
+        long long id = lease;
+        if (id >= 0)
+          ask_coordinator("heartbeat " + to_string(id));
+        last = util::get_time();
+      }
+    }
+  });
+  for (;;) {
+    istringstream in(ask_coordinator("lease " + to_string(count)));
+    string cmd;
+    size_t id;
+    index_t lo, hi;
+    in >> cmd;
+    if (cmd == "wait") {
+      usleep(PROGRESS_INTERVAL);
+      continue;
+    }
+    if (cmd != "range" || !(in >> id >> lo >> hi))
+      break;
+    range_first = lo;
+    range_last = hi;
+    pending = RangeList(vector<Interval>(1, Interval(lo, hi)));
+    lease = id;
+    double start = util::get_time();
+    run(cb_done, cb_match);
+    wait_reported();
+    double time = util::get_time() - start;
+    lease = -1;
+    ask_coordinator("complete " + to_string(id) + " " + index_str(lo) + " " + index_str(hi));
+    count = max(SCHEDULER_CHUNK, (size_t)((hi - lo) / max(time, 1e-3) * LEASE_DURATION));
+  }
+  stopped = true;
+  heartbeat.join();
+}
+
+// What a worker thread tells the reporter thread: a match with index first,
+// or that the indices [first, last) are done
+struct Report {
+  bool is_match;
+  index_t first, last;
+  string candidate;
+  unsigned char digest[hash_size];
+};
+
+// Parses an alphabet specification, =chars or :lo:hi, into alph. Returns
+// false if spec is neither.
+bool parse_alphabet(const string& spec, string& alph) {
+  int lo, hi;
+  if (spec[0] == '=') {
+    alph = spec.substr(1);
+    return true;
+  }
+  if (spec[0] != ':' || sscanf(spec.c_str(), ":%d:%d", &lo, &hi) != 2)
+    return false;
+  alph.clear();
+  for (int i = lo; i <= hi; ++i)
+    alph += (char)i;
+  return true;
 }
 
 void usage(char *argv0) {
   cerr << "Usage: " << argv0 << " [FLAGS] pattern_string "
        << "alphabet0 [alphabet1 [...]]" << endl
+       << "       " << argv0 << " [FLAGS] -w wordlist [pattern_string [alphabet0 [...]]]" << endl
        << endl
        << "pattern_string" << endl
-       << "  is a string with ? chars as placeholders" << endl
+       << "  is a string with ? chars as placeholders. With -w, it also has a single *" << endl
+       << "  where the words go, and defaults to just that. Every word is then tried" << endl
+       << "  with all strings of the ? mask, if any" << endl
        << endl
        << "alphabetX" << endl
        << "  is an alphabet specification in one of two formats:" << endl
@@ -294,10 +910,66 @@ void usage(char *argv0) {
        <<                "Use OpenCL. Currently only supports a subset of patterns," << endl
        << "              specifically ones where the wildcards are all contiguous and" << endl
        << "              there is only one contiguous charset. I.e. <prefix>\?\?...\?\?<suffix>" << endl
+       << "  --increment MIN:MAX" << endl
+       << "              Try the pattern with just its first MIN, MIN + 1, ..., MAX" << endl
+       << "              ? wildcards and the others removed, shortest first, in" << endl
+       << "              one run. --skip and --limit count the strings of all lengths" << endl
+       << "  --masks FILE" << endl
+       << "              Try the masks in FILE, one per line, instead of a single" << endl
+       << "              pattern: the pattern and its alphabets, separated by" << endl
+       << "              commas, with \\, for a comma and \\\\ for a backslash." << endl
+       << "              Strings that an earlier mask has are not tried again" << endl
+       << "  -w FILE     Try every line of FILE as the * of the pattern" << endl
+       << "  -r FILE     Try every word of -w with every rule in FILE, a rule file" << endl
+       << "              in hashcat syntax" << endl
+       << "  --targets FILE" << endl
+       << "              Look for the hex digests in FILE, one per line, instead of" << endl
+       << "              strings that pass the check of the config. Without -a, stops" << endl
+       << "              once all of them are found. FILE may also be an index" << endl
+       << "              written by --build-index" << endl
+       << "  --prefilter BITS" << endl
+       << "              Screen candidates against the --targets with a Bloom" << endl
+       << "              filter of 2^BITS bits before looking them up, 0 to" << endl
+       << "              disable. By default sized at 16 bits per target" << endl
+       << "  --markov FILE" << endl
+       << "              Try the characters of every wildcard in the order of how" << endl
+       << "              likely they follow the character in front of it, by the" << endl
+       << "              statistics in FILE, so that likely strings come first" << endl
+       << "  --train-markov FILE -o OUT" << endl
+       << "              Write the --markov statistics of the wordlist FILE to OUT." << endl
+       << "              No pattern or alphabets needed" << endl
+       << "  --build-index FILE -o OUT" << endl
+       << "              Sort the hex digests in FILE into the binary index OUT," << endl
+       << "              which --targets maps instead of parsing it. No pattern" << endl
+       << "              or alphabets needed" << endl
+       << "  --skip N    Skip the first N strings of the keyspace" << endl
+       << "  --limit M   Test at most M strings. Together with --skip this runs" << endl
+       << "              an arbitrary sub-range of the keyspace" << endl
+       << "  --shard i/N Only run the i-th of N equal slices of the range," << endl
+       << "              0 <= i < N, to split a search across N machines" << endl
+       << "  --checkpoint FILE" << endl
+       << "              Periodically record the finished parts of the keyspace" << endl
+       << "              and the matches found so far in FILE" << endl
+       << "  --restore   Resume the search from the --checkpoint file" << endl
+       << "  --serve ADDR" << endl
+       << "              Coordinate the search: lease ranges of the keyspace to" << endl
+       << "              --worker processes that connect to ADDR, which is either" << endl
+       << "              unix:PATH or HOST:PORT" << endl
+       << "  --worker ADDR" << endl
+       << "              Take the pattern and ranges to run from the coordinator" << endl
+       << "              at ADDR. No pattern or alphabets needed, but the same" << endl
+       << "              --targets as the coordinator, if it has any" << endl
        << "  -h          Show this help" << endl
        << endl
        << "EXAMPLES" << endl
-       << "  " << argv0 << " -t 4 \"My name is \?\?\?\" :97:122" << endl;
+       << "  " << argv0 << " -t 4 \"My name is \?\?\?\" :97:122" << endl
+       << "  " << argv0 << " -t 4 --increment 1:6 \"\?\?\?\?\?\?\" :97:122" << endl
+       << "  " << argv0 << " -t 4 --masks masks.txt" << endl
+       << "  " << argv0 << " -t 4 -w words.txt \"*2024!\"" << endl
+       << "  " << argv0 << " -t 4 -w words.txt \"*??\" :48:57" << endl
+       << "  " << argv0 << " -t 4 -w words.txt -r best64.rule" << endl
+       << "  " << argv0 << " --serve :7000 \"My name is \?\?\?\?\?\" :97:122" << endl
+       << "  " << argv0 << " --worker coordinator-host:7000 -t 8" << endl;
   exit(EXIT_FAILURE);
 }
 
@@ -305,13 +977,128 @@ void parse_opts(int argc, char **argv) {
   int pos = 0;
   for (int i = 1; i < argc; ++i) {
     if (string(argv[i]) == "-t") {
+      char end;
+      if (i + 1 >= argc)
+        usage(argv[0]);
+      if (sscanf(argv[i+1], "%d%c", &num_threads, &end) != 1 || num_threads < 1) {
+        cerr << "Invalid number of threads: " << argv[i+1] << endl;
+        usage(argv[0]);
+      }
+      i++;
+      continue;
+    }
+    if (string(argv[i]) == "--skip" || string(argv[i]) == "--limit") {
+      index_t val;
+      if (i + 1 >= argc)
+        usage(argv[0]);
+      if (!parse_index(argv[i+1], val)) {
+        cerr << "Invalid number: " << argv[i+1] << endl;
+        usage(argv[0]);
+      }
+      (string(argv[i]) == "--skip" ? skip : limit) = val;
+      i++;
+      continue;
+    }
+    if (string(argv[i]) == "--shard") {
+      char end;
+      if (i + 1 >= argc)
+        usage(argv[0]);
+      if (sscanf(argv[i+1], "%zu/%zu%c", &shard, &num_shards, &end) != 2
+          || num_shards == 0 || shard >= num_shards) {
+        cerr << "Invalid shard specification: " << argv[i+1] << endl;
+        usage(argv[0]);
+      }
+      i++;
+      continue;
+    }
+    if (string(argv[i]) == "--increment") {
+      char end;
+      if (i + 1 >= argc)
+        usage(argv[0]);
+      if (sscanf(argv[i+1], "%d:%d%c", &increment_min, &increment_max, &end) != 2
+          || increment_min < 1 || increment_min > increment_max) {
+        cerr << "Invalid increment: " << argv[i+1] << endl;
+        usage(argv[0]);
+      }
+      i++;
+      continue;
+    }
+    if (string(argv[i]) == "--checkpoint") {
       if (i + 1 < argc)
-        num_threads = atoi(argv[i+1]);
+        checkpoint_file = argv[i+1];
       else
         usage(argv[0]);
       i++;
       continue;
     }
+    if (string(argv[i]) == "--targets") {
+      if (i + 1 < argc)
+        targets_file = argv[i+1];
+      else
+        usage(argv[0]);
+      i++;
+      continue;
+    }
+    if (string(argv[i]) == "-w") {
+      if (i + 1 < argc)
+        wordlist_file = argv[i+1];
+      else
+        usage(argv[0]);
+      i++;
+      continue;
+    }
+    if (string(argv[i]) == "--masks") {
+      if (i + 1 < argc)
+        masks_file = argv[i+1];
+      else
+        usage(argv[0]);
+      i++;
+      continue;
+    }
+    if (string(argv[i]) == "-r") {
+      if (i + 1 < argc)
+        rules_file = argv[i+1];
+      else
+        usage(argv[0]);
+      i++;
+      continue;
+    }
+    if (string(argv[i]) == "--prefilter") {
+      if (i + 1 >= argc)
+        usage(argv[0]);
+      prefilter_bits = atoi(argv[i+1]);
+      if (prefilter_bits < 0 || prefilter_bits > 32) {
+        cerr << "Invalid prefilter size: " << argv[i+1] << endl;
+        usage(argv[0]);
+      }
+      i++;
+      continue;
+    }
+    if (string(argv[i]) == "--build-index" || string(argv[i]) == "-o") {
+      if (i + 1 >= argc)
+        usage(argv[0]);
+      (string(argv[i]) == "-o" ? output_file : build_index_file) = argv[i+1];
+      i++;
+      continue;
+    }
+    if (string(argv[i]) == "--markov" || string(argv[i]) == "--train-markov") {
+      if (i + 1 >= argc)
+        usage(argv[0]);
+      (string(argv[i]) == "--markov" ? markov_file : train_markov_file) = argv[i+1];
+      i++;
+      continue;
+    }
+    if (string(argv[i]) == "--serve" || string(argv[i]) == "--worker") {
+      if (i + 1 >= argc)
+        usage(argv[0]);
+      (string(argv[i]) == "--serve" ? serve_addr : worker_addr) = argv[i+1];
+      i++;
+      continue;
+    }
+    if (string(argv[i]) == "--restore") {
+      restore = true;
+      continue;
+    }
     if (string(argv[i]) == "-a") {
       compute_all = true;
       continue;
@@ -329,26 +1116,42 @@ void parse_opts(int argc, char **argv) {
     }
     if (pos == 0) pattern = argv[i];
     if (pos >= 1) {
-      if (argv[i][0] == '=') {
-        alphabets.emplace_back(argv[i]+1);
-      } else if (argv[i][0] == ':') {
-        int lo, hi;
-        if (sscanf(argv[i], ":%d:%d", &lo, &hi) != 2) {
-          cerr << "Invalid alphabet specification: " << argv[i] << endl;
-          usage(argv[0]);
-        }
-        string alph;
-        for (int i = lo; i <= hi; ++i)
-          alph += (char)i;
-        alphabets.emplace_back(alph);
-      } else {
+      string alph;
+      if (!parse_alphabet(argv[i], alph)) {
         cerr << "Invalid alphabet specification: " << argv[i] << endl;
         usage(argv[0]);
       }
+      alphabets.push_back(alph);
     }
     pos++;
   }
-  if (pos < 2) {
+  if (!build_index_file.empty() || !train_markov_file.empty() || !output_file.empty()) {
+    if (build_index_file.empty() == train_markov_file.empty() || output_file.empty() || pos > 0) {
+      cerr << "--build-index and --train-markov take an input and an -o output file only" << endl;
+      exit(1);
+    }
+    return;
+  }
+  if (!worker_addr.empty()) {
+    if (pos > 0 || !serve_addr.empty() || !checkpoint_file.empty() || !wordlist_file.empty()
+        || !masks_file.empty() || skip || limit != INDEX_MAX || num_shards > 1) {
+      cerr << "A worker gets its pattern and ranges from the coordinator" << endl;
+      exit(1);
+    }
+  } else if (!wordlist_file.empty()) {
+    if (pos == 0)
+      pattern = "*";
+    if (use_opencl || !serve_addr.empty() || !masks_file.empty()) {
+      cerr << "A wordlist can not be used with OpenCL, --serve or --masks" << endl;
+      exit(1);
+    }
+  } else if (!masks_file.empty()) {
+    if (pos > 0 || !serve_addr.empty()) {
+      cerr << "--masks takes the place of the pattern and alphabets, and can not be "
+              "used with --serve" << endl;
+      exit(1);
+    }
+  } else if (pos < 2) {
     usage(argv[0]);
   }
   if (use_opencl && !HAVE_OPENCL) {
@@ -359,26 +1162,215 @@ void parse_opts(int argc, char **argv) {
     cerr << "The plugin you use does not support OpenCL" << endl;
     exit(1);
   }
+  if (use_opencl && !targets_file.empty()) {
+    cerr << "--targets is not supported with OpenCL" << endl;
+    exit(1);
+  }
+  if (!markov_file.empty() && (use_opencl || !serve_addr.empty() || !worker_addr.empty())) {
+    cerr << "--markov can not be used with OpenCL, --serve or --worker" << endl;
+    exit(1);
+  }
+  if (increment_max && (!wordlist_file.empty() || !serve_addr.empty() || !worker_addr.empty())) {
+    cerr << "--increment can not be used with -w, --serve or --worker" << endl;
+    exit(1);
+  }
+  if (!rules_file.empty() && wordlist_file.empty()) {
+    cerr << "-r applies its rules to the words of a -w wordlist" << endl;
+    exit(1);
+  }
+  if (restore && checkpoint_file.empty()) {
+    cerr << "--restore needs a --checkpoint file" << endl;
+    exit(1);
+  }
   if (num_threads > 1 && use_opencl) {
     cerr << "Can't use both multithreading and OpenCL" << endl;
     exit(1);
   }
 }
 
+// Writes the index of the --build-index list to the -o file
+void build_index() {
+  size_t count;
+  try {
+    count = TargetTable<hash_size>::build_index(build_index_file, output_file);
+  } catch (const IOException& e) {
+    cerr << e.what() << endl;
+    exit(1);
+  }
+  if (verbose)
+    cout << "Wrote " << count << " digests to " << output_file << endl;
+}
+
+// Writes the statistics of the --train-markov wordlist to the -o file
+void train_markov() {
+  Wordlist list;
+  MarkovModel model;
+  try {
+    list.load(train_markov_file);
+    model.train(list);
+    model.save(output_file);
+  } catch (const IOException& e) {
+    cerr << e.what() << endl;
+    exit(1);
+  }
+  if (verbose)
+    cout << "Wrote the statistics of " << list.size() << " words to " << output_file << endl;
+}
+
+// Reads the --masks file into masks, with the lengths of the --increment, if
+// any. Only the strings that no earlier mask has are added; with OpenCL,
+// whose kernel needs a single alphabet, only masks inside an earlier one
+// are left out.
+void load_masks() {
+  string text;
+  try {
+    text = read_file(masks_file);
+  } catch (const IOException& e) {
+    cerr << e.what() << endl;
+    exit(1);
+  }
+  istringstream in(text);
+  string line;
+  size_t num_masks = 0, skipped = 0, trimmed = 0;
+  index_t dropped = 0;
+  for (size_t nr = 1; getline(in, line); ++nr) {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    if (line.empty() || line[0] == '#')
+      continue;
+    vector<string> fields(1);
+    for (size_t i = 0; i < line.size(); ++i) {
+      if (line[i] == '\\' && i + 1 < line.size())
+        fields.back() += line[++i];
+      else if (line[i] == ',')
+        fields.emplace_back();
+      else
+        fields.back() += line[i];
+    }
+    string where = masks_file + ":" + to_string(nr) + ": ";
+    vector<int> positions;
+    for (size_t i = 0; i < fields[0].size(); ++i) {
+      if (fields[0][i] == '?')
+        positions.push_back(i);
+    }
+    if (positions.empty() || fields.size() < 2) {
+      cerr << where << "a mask needs ? wildcards and an alphabet" << endl;
+      exit(1);
+    }
+    vector<string> alphs;
+    for (size_t i = 1; i < fields.size(); ++i) {
+      string alph;
+      if (!parse_alphabet(fields[i], alph)) {
+        cerr << where << "invalid alphabet specification " << fields[i] << endl;
+        exit(1);
+      }
+      alphs.push_back(alph);
+    }
+    vector<string> wildcard_alphabets;
+    for (size_t i = 0; i < positions.size(); ++i)
+      wildcard_alphabets.push_back(alphs[min(i, alphs.size() - 1)]);
+    Keyspace mask(fields[0], positions, wildcard_alphabets);
+    int lo = mask.num_wildcards(), hi = mask.num_wildcards();
+    if (increment_max) {
+      lo = increment_min;
+      hi = min(increment_max, hi);
+    }
+    for (int n = lo; n <= hi; ++n) {
+      Keyspace ks = n < mask.num_wildcards() ? mask.head(n) : mask;
+      if (ks.overflows()) {
+        cerr << where << "overflow when computing total number of possibilities" << endl;
+        exit(1);
+      }
+      index_t left_out = masks.add_new(ks, !use_opencl);
+      num_masks++;
+      if (left_out == ks.size())
+        skipped++;
+      else if (left_out)
+        trimmed++;
+      dropped += left_out;
+    }
+  }
+  if (!masks.count()) {
+    cerr << "No masks in " << masks_file << endl;
+    exit(1);
+  }
+  if (verbose) {
+    cout << "  Masks: " << masks_file << ", " << num_masks << " masks" << endl;
+    if (skipped || trimmed) {
+      cout << "  Overlaps: " << skipped << " masks skipped, " << trimmed
+           << " trimmed, " << dropped << " strings left out" << endl;
+    }
+  }
+}
+
 int main(int argc, char **argv) {
   parse_opts(argc, argv);
+  if (!build_index_file.empty()) {
+    build_index();
+    return 0;
+  }
+  if (!train_markov_file.empty()) {
+    train_markov();
+    return 0;
+  }
+  if (!worker_addr.empty()) {
+    try {
+      coordinator.reset(new Connection(connect_to(worker_addr)));
+    } catch (const IOException& e) {
+      cerr << e.what() << endl;
+      exit(1);
+    }
+    istringstream in(ask_coordinator("hello"));
+    string cmd, arg;
+    in >> cmd >> arg;
+    if (cmd != "job" || !is_hex(arg)) {
+      cerr << "Unexpected reply from the coordinator: " << cmd << endl;
+      exit(1);
+    }
+    pattern = from_hex(arg);
+    while (in >> arg && is_hex(arg))
+      alphabets.push_back(from_hex(arg));
+    if (arg == "targets")
+      in >> job_targets;
+    // Matches go to the coordinator, which decides when to stop
+    compute_all = true;
+  }
   for (size_t i = 0; i < pattern.size(); ++i) {
     if (pattern[i] == '?')
       wildcard_positions.push_back(i);
   }
-  if (wildcard_positions.empty()) {
+  if (!wordlist_file.empty()) {
+    size_t word_pos = pattern.find('*');
+    if (word_pos == string::npos) {
+      cerr << "With a wordlist, the pattern needs a * where the words go" << endl;
+      exit(1);
+    }
+    if (pattern.find('*', word_pos + 1) != string::npos) {
+      cerr << "The pattern can only have a single * for the words" << endl;
+      usage(argv[0]);
+    }
+    if (!wildcard_positions.empty() && alphabets.empty()) {
+      cerr << "The ? wildcards of the pattern need an alphabet" << endl;
+      exit(1);
+    }
+    word_prefix = pattern.substr(0, word_pos);
+    word_suffix = pattern.substr(word_pos + 1);
+    mask_split = lower_bound(begin(wildcard_positions), end(wildcard_positions), (int)word_pos)
+        - begin(wildcard_positions);
+  } else if (wildcard_positions.empty() && masks_file.empty()) {
     cerr << "No wildcards, not sure what you want to achieve..." << endl;
     exit(1);
   }
+  if (increment_max > (int)wildcard_positions.size() && masks_file.empty()) {
+    cerr << "Cannot increment to " << increment_max << " wildcards, the pattern only has "
+         << wildcard_positions.size() << endl;
+    exit(1);
+  }
   if (verbose) {
     cout << "INFO" << endl;
     cout << "  Threads: " << num_threads << endl;
-    cout << "  Pattern: " << pattern << endl;
+    if (masks_file.empty())
+      cout << "  Pattern: " << pattern << endl;
     for (size_t i = 0; i < alphabets.size(); ++i) {
       if (i < alphabets.size() - 1 || alphabets.size() == wildcard_positions.size())
         cout << "  Alphabet for position " << wildcard_positions[i];
@@ -390,23 +1382,170 @@ int main(int argc, char **argv) {
       print_repr_string(begin(alph), end(alph));
       cout << endl;
     }
+    if (increment_max)
+      cout << "  Increment: " << increment_min << ".." << increment_max << " wildcards" << endl;
   }
-  size_t total = 1;
-  for (size_t i = 0; i < wildcard_positions.size(); ++i) {
-    size_t base = (i < alphabets.size()) ? alphabets[i].size() : alphabets.back().size();
-    size_t new_total = total * base;
-    if (new_total / base != total) {
+  if (!targets_file.empty()) {
+    try {
+      targets.load(targets_file);
+    } catch (const IOException& e) {
+      cerr << e.what() << endl;
+      exit(1);
+    }
+    if (targets.empty()) {
+      cerr << "No targets in " << targets_file << endl;
+      exit(1);
+    }
+    targets.build_prefilter(prefilter_bits);
+    if (verbose) {
+      cout << "  Targets: " << targets.size() << endl;
+      if (targets.prefilter_size()) {
+        cout << "  Prefilter: " << targets.prefilter_size() / 1024 << " KiB, "
+             << setprecision(3) << 100 * targets.prefilter_rate() << "% pass" << endl;
+      }
+    }
+    if (targets.prefilter_size() && targets.prefilter_rate() > PREFILTER_MAX_RATE)
+      cerr << "Warning: the --prefilter is too small for " << targets.size() << " targets" << endl;
+  }
+  // A worker must look for the very digests of the coordinator, whose
+  // passes() checks what it reports
+  if (coordinator && job_targets != (targets.empty() ? "" : to_string(targets.fingerprint()))) {
+    cerr << (job_targets.empty() ? "The coordinator has no --targets"
+             : "Pass the same --targets as the coordinator") << endl;
+    exit(1);
+  }
+  vector<string> wildcard_alphabets;
+  for (size_t i = 0; i < wildcard_positions.size(); ++i)
+    wildcard_alphabets.push_back(alphabet_for(i));
+  // The mask of a wordlist pattern is laid out as if the '*' matched nothing
+  string mask_pattern = pattern;
+  vector<int> mask_positions = wildcard_positions;
+  if (!wordlist_file.empty()) {
+    mask_pattern.erase(word_prefix.size(), 1);
+    for (int i = mask_split; i < (int)mask_positions.size(); ++i)
+      mask_positions[i]--;
+  }
+  keyspace = Keyspace(mask_pattern, mask_positions, wildcard_alphabets);
+  if (!masks_file.empty()) {
+    load_masks();
+  } else if (wordlist_file.empty()) {
+    // Every length of an increment gets a keyspace of its own, laid out
+    // like the pattern of that length
+    if (!increment_max)
+      increment_min = increment_max = keyspace.num_wildcards();
+    for (int n = increment_min; n <= increment_max; ++n)
+      masks.add(n < keyspace.num_wildcards() ? keyspace.head(n) : keyspace);
+  }
+  if (wordlist_file.empty() ? masks.overflows() : keyspace.overflows()) {
+    cerr << "Overflow when computing total number of possibilities, use less "
+            "wildcards or smaller alphabets!" << endl;
+    exit(1);
+  }
+  if (!markov_file.empty()) {
+    try {
+      markov.load(markov_file);
+    } catch (const IOException& e) {
+      cerr << e.what() << endl;
+      exit(1);
+    }
+    if (!wordlist_file.empty())
+      markov.apply(keyspace, mask_split);
+    for (size_t i = 0; i < masks.count(); ++i)
+      markov.apply(masks[i]);
+    if (verbose)
+      cout << "  Markov order: " << markov_file << endl;
+  }
+  index_t space = wordlist_file.empty() ? masks.size() : keyspace.size();
+  if (!wordlist_file.empty()) {
+    try {
+      words.load(wordlist_file);
+      if (!rules_file.empty())
+        rules.load(rules_file);
+    } catch (const IOException& e) {
+      cerr << e.what() << endl;
+      exit(1);
+    }
+    index_t per_word = rules.size() * keyspace.size();
+    if (keyspace.size() > INDEX_MAX / rules.size() || words.size() > INDEX_MAX / per_word) {
       cerr << "Overflow when computing total number of possibilities, use less "
               "wildcards or smaller alphabets!" << endl;
       exit(1);
     }
-    total = new_total;
+    space = words.size() * per_word;
+    if (verbose) {
+      cout << "  Wordlist: " << wordlist_file << ", " << words.size() << " words" << endl;
+      if (!rules_file.empty())
+        cout << "  Rules: " << rules_file << ", " << rules.size() << " rules" << endl;
+    }
   }
+  if (skip > space) {
+    cerr << "Cannot skip " << skip << " strings, the keyspace only has "
+         << space << endl;
+    exit(1);
+  }
+  range_first = skip;
+  range_last = skip + min(limit, space - skip);
+  if (num_shards > 1) {
+    index_t n = range_last - range_first;
+    range_first += n / num_shards * shard + min<index_t>(shard, n % num_shards);
+    range_last = range_first + n / num_shards + (shard < n % num_shards);
+    if (verbose)
+      cout << "  Shard: " << shard << " of " << num_shards << endl;
+  }
+  index_t total = range_last - range_first;
+  if (verbose && total != space) {
+    cout << "  Range: [" << range_first << ", " << range_last << ") of "
+         << space << " strings" << endl;
+  }
+  if (verbose && !serve_addr.empty())
+    cout << "  Serving on " << serve_addr << endl;
+  if (verbose && !worker_addr.empty())
+    cout << "  Working for " << worker_addr << endl;
+  unique_ptr<Checkpoint> checkpoint;
+  IntervalSet done;
+  if (!checkpoint_file.empty()) {
+    // A checkpoint only applies to the exact same keyspace and range
+    string job = pattern;
+    for (auto& alph : wildcard_alphabets)
+      job += '\0' + alph;
+    if (!wordlist_file.empty())
+      job += '\0' + wordlist_file + " " + index_str(words.size()) + " " + to_string(words.fingerprint());
+    if (!rules_file.empty())
+      job += '\0' + to_string(rules.fingerprint());
+    if (!markov_file.empty())
+      job += '\0' + to_string(markov.fingerprint());
+    if (masks.count() > 1)
+      job += '\0' + to_string(increment_min) + ":" + to_string(increment_max);
+    if (!masks_file.empty())
+      job += '\0' + masks_file + " " + to_string(masks.fingerprint());
+    job += '\0' + index_str(range_first) + " " + index_str(range_last);
+    if (!targets.empty())
+      job += '\0' + to_string(targets.fingerprint());
+    checkpoint.reset(new Checkpoint(checkpoint_file, job));
+    // Save the checkpoint on Ctrl+C, from the checkpoint writer thread
+    signal(SIGINT, [](int) { interrupted = true; });
+    if (restore) {
+      try {
+        checkpoint->load();
+      } catch (const IOException& e) {
+        cerr << e.what() << endl;
+        exit(1);
+      }
+      done = checkpoint->completed();
+      if (verbose) {
+        cout << "  Restored: " << done.count() << " strings done, "
+             << checkpoint->found().size() << " matches" << endl;
+      }
+    }
+  }
+  pending = RangeList(done.complement(range_first, range_last));
   double start_time = util::get_time();
   mutex mx;
   cout << fixed << setprecision(2);
   size_t matches = 0;
-  atomic<size_t> current(0);
+  set<string> found; // distinct digests of the matches
+  index_t restored = total - pending.size();
+  progress = ProgressCounters(num_threads);
   atomic<bool> finished(false);
   std::thread progress_printer([&]() {
     if (verbose) {
@@ -415,53 +1554,168 @@ int main(int argc, char **argv) {
         {
           lock_guard<mutex> lg(mx);
           double time = util::get_time() - start_time;
-          cout << "\rPROGRESS " << current << " / " << total
-              << " (" << (100.*current/total) << "%, "
-              << time << " sec, "
+          index_t current = progress.sum();
+          index_t count = restored + current;
+          cout << "\rPROGRESS " << count;
+          if (!coordinator)
+            cout << " / " << total << " (" << (100.*count/total) << "%, ";
+          else
+            cout << " (";
+          cout << time << " sec, "
               << (current/time/1e6) << "mh/s)       " << flush;
         }
       } while (!finished);
     }
   });
-  run(
-    [&](size_t add_progress) {
-      if (verbose && add_progress)
-        current += add_progress;
-    },
-    [&](const string& match) {
-      lock_guard<mutex> lg(mx);
-      matches++;
+  auto save_checkpoint = [&]() {
+    try {
+      checkpoint->save();
+    } catch (const IOException& e) {
+      cerr << e.what() << endl;
+    }
+  };
+  std::thread checkpoint_writer([&]() {
+    if (checkpoint) {
+      double last_save = util::get_time();
+      while (!finished) {
+        usleep(PROGRESS_INTERVAL);
+        if (interrupted) {
+          save_checkpoint();
+          exit(130);
+        }
+        // New matches are saved on the next tick, the intervals less often
+        if (checkpoint->dirty() || util::get_time() - last_save >= CHECKPOINT_INTERVAL) {
+          save_checkpoint();
+          last_save = util::get_time();
+        }
+      }
+    }
+  });
+  vector<AlignedPtr<SpscQueue<Report>>> reports;
+  for (int t = 0; t < num_threads; ++t)
+    reports.push_back(make_aligned<SpscQueue<Report>>(REPORT_QUEUE_SIZE));
+  auto report_match = [&](const Report& r) {
+    lock_guard<mutex> lg(mx);
+    const string& match = r.candidate;
+    matches++;
+    // The digest comes from the hash kernels, recheck a sample of them
+    if (verify && (matches <= VERIFY_FIRST || matches % VERIFY_EVERY == 0)) {
       unsigned char hash[hash_size];
       compute_hash((const unsigned char*)match.c_str(), match.size(), hash);
-      if (verbose) {
-        cout << endl << "MATCH" << endl;
-        cout << "  Time: " << (util::get_time() - start_time) << " sec" << endl;
-        cout << "  String: ";
-      }
-      print_repr_string(begin(match), end(match));
-      cout << endl;
-      if (verify && !check(hash)) {
+      if (!equal(hash, hash + hash_size, r.digest) || !passes(hash)) {
         cerr << "Verification failed. The reported string does not actually pass the check." << endl;
         exit(1);
       }
-      if (verbose) {
-        cout << "  Hash: ";
-        print_hex(hash, 16);
-        cout << endl;
+    }
+    if (verbose) {
+      cout << endl << "MATCH" << endl;
+      cout << "  Time: " << (util::get_time() - start_time) << " sec" << endl;
+      cout << "  String: ";
+    }
+    print_repr_string(begin(match), end(match));
+    cout << endl;
+    if (verbose) {
+      if (r.is_match)
+        cout << "  Index: " << r.first << endl;
+      cout << "  Hash: ";
+      print_hex(r.digest, hash_size);
+      cout << endl;
+    }
+    found.insert(string(r.digest, r.digest + hash_size));
+    if (!compute_all && (targets.empty() || found.size() == targets.size())) {
+      if (checkpoint)
+        save_checkpoint();
+      exit(0);
+    }
+  };
+  if (checkpoint) {
+    for (auto& match : checkpoint->found()) {
+      Report r;
+      // The index of a restored match is only known for a mask
+      r.is_match = wordlist_file.empty() && masks.encode(match, r.first);
+      r.candidate = match;
+      compute_hash((const unsigned char*)match.c_str(), match.size(), r.digest);
+      report_match(r);
+    }
+  }
+  // Workers hand their matches, and the intervals they finished if there is a
+  // checkpoint, to the reporter thread through one queue per thread. They
+  // never wait for a lock or for output, and the reporter always records a
+  // match before the interval it was found in.
+  atomic<bool> engines_done(false);
+  atomic<size_t> matches_queued(0), matches_reported(0);
+  std::thread reporter([&]() {
+    Report r;
+    for (;;) {
+      bool last_round = engines_done;
+      bool idle = true;
+      for (auto& q : reports) {
+        while (q->pop(r)) {
+          idle = false;
+          if (!r.is_match) {
+            checkpoint->mark_done(r.first, r.last);
+            continue;
+          }
+          // Record the match before report_match() might exit
+          if (checkpoint)
+            checkpoint->add_match(r.candidate);
+          if (coordinator)
+            ask_coordinator("match " + to_hex(r.candidate));
+          report_match(r);
+          matches_reported++;
+        }
       }
-      if (!compute_all)
-        exit(0);
+      if (last_round)
+        break;
+      if (idle)
+        usleep(REPORT_INTERVAL);
     }
-  );
+  });
+  auto on_done = [&](int t, index_t first, index_t last) {
+    if (checkpoint) {
+      Report r;
+      r.is_match = false;
+      r.first = first;
+      r.last = last;
+      reports[t]->push(r);
+    }
+  };
+  auto on_match = [&](int t, const string& match, const unsigned char *digest, index_t index) {
+    Report r;
+    r.is_match = true;
+    r.first = index;
+    r.last = index + 1;
+    r.candidate = match;
+    copy(digest, digest + hash_size, r.digest);
+    matches_queued++;
+    reports[t]->push(r);
+  };
+  // Returns once the reporter has handled all matches queued so far
+  auto wait_reported = [&]() {
+    while (matches_reported < matches_queued)
+      usleep(REPORT_INTERVAL);
+  };
+  if (!serve_addr.empty())
+    serve(on_done, on_match);
+  else if (coordinator)
+    work(on_done, on_match, wait_reported);
+  else
+    run(on_done, on_match);
+  engines_done.store(true);
+  reporter.join();
   finished.store(true);
   progress_printer.join();
+  checkpoint_writer.join();
+  if (checkpoint)
+    save_checkpoint();
   if (verbose) {
     double time = util::get_time() - start_time;
+    index_t tested = progress.sum();
     cout << endl;
     cout << "STATS" << endl;
-    cout << "  Tested strings: " << total << endl;
+    cout << "  Tested strings: " << tested << endl;
     cout << "  Matches: " << matches << endl;
     cout << "  Time: " << time << " sec" << endl;
-    cout << "  Speed: " << (total/time/1e6) << " mhashes/sec" << endl;
+    cout << "  Speed: " << (tested/time/1e6) << " mhashes/sec" << endl;
   }
 }
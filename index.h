@@ -0,0 +1,47 @@
+#ifndef _INDEX_H
+#define _INDEX_H
+
+#include <iostream>
+#include <string>
+
+// Candidate indices. The keyspaces of large masks exceed 2^64 strings, so
+// indices, totals and range bounds are 128 bits wide. Counts of strings that
+// one process actually tests still fit into a size_t.
+typedef unsigned __int128 index_t;
+
+const index_t INDEX_MAX = ~(index_t)0;
+
+std::string index_str(index_t x) {
+  std::string res;
+  do {
+    res.insert(res.begin(), (char)('0' + (int)(x % 10)));
+    x /= 10;
+  } while (x);
+  return res;
+}
+
+// Parses a decimal index. Returns false on junk or overflow.
+bool parse_index(const std::string& s, index_t& res) {
+  if (s.empty())
+    return false;
+  res = 0;
+  for (char c : s) {
+    if (c < '0' || c > '9' || res > (INDEX_MAX - (c - '0')) / 10)
+      return false;
+    res = res * 10 + (c - '0');
+  }
+  return true;
+}
+
+std::ostream& operator<<(std::ostream& os, index_t x) {
+  return os << index_str(x);
+}
+
+std::istream& operator>>(std::istream& is, index_t& x) {
+  std::string s;
+  if (is >> s && !parse_index(s, x))
+    is.setstate(std::ios::failbit);
+  return is;
+}
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef _INTERVALS_H
+#define _INTERVALS_H
+
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "index.h"
+
+typedef std::pair<index_t, index_t> Interval; // half-open [first, second)
+
+// Set of disjoint index intervals, merged on insertion
+class IntervalSet {
+  std::map<index_t, index_t> iv; // lo -> hi
+  index_t total;
+
+public:
+  IntervalSet() : total(0) {}
+
+  void add(index_t lo, index_t hi) {
+    if (lo >= hi)
+      return;
+    auto it = iv.upper_bound(lo);
+    if (it != iv.begin() && prev(it)->second >= lo)
+      --it;
+    while (it != iv.end() && it->first <= hi) {
+      lo = std::min(lo, it->first);
+      hi = std::max(hi, it->second);
+      total -= it->second - it->first;
+      it = iv.erase(it);
+    }
+    iv[lo] = hi;
+    total += hi - lo;
+  }
+
+  // Number of indices in the set
+  index_t count() const {
+    return total;
+  }
+
+  std::vector<Interval> intervals() const {
+    return std::vector<Interval>(iv.begin(), iv.end());
+  }
+
+  // The parts of [lo, hi) that are not in the set
+  std::vector<Interval> complement(index_t lo, index_t hi) const {
+    std::vector<Interval> res;
+    for (auto& i : iv) {
+      if (i.second <= lo)
+        continue;
+      if (i.first >= hi)
+        break;
+      if (i.first > lo)
+        res.emplace_back(lo, i.first);
+      lo = std::max(lo, i.second);
+    }
+    if (lo < hi)
+      res.emplace_back(lo, hi);
+    return res;
+  }
+};
+
+// Concatenation of disjoint index intervals, addressed by a contiguous
+// "virtual" index in [0, size()). Lets a scheduler hand out the pieces of a
+// fragmented keyspace as if it were a single range.
+class RangeList {
+  std::vector<Interval> ranges;
+  std::vector<index_t> offsets; // virtual index of every range's start
+  index_t total;
+
+public:
+  RangeList() : total(0) {}
+
+  explicit RangeList(const std::vector<Interval>& ranges) : total(0) {
+    for (auto& r : ranges) {
+      if (r.first >= r.second)
+        continue;
+      this->ranges.push_back(r);
+      offsets.push_back(total);
+      total += r.second - r.first;
+    }
+  }
+
+  index_t size() const {
+    return total;
+  }
+
+  const std::vector<Interval>& intervals() const {
+    return ranges;
+  }
+
+  // Calls cb(first, last) for the real intervals covering the virtual range [lo, hi)
+  template <typename F>
+  void map(index_t lo, index_t hi, F cb) const {
+    size_t i = std::upper_bound(offsets.begin(), offsets.end(), lo) - offsets.begin() - 1;
+    for (; lo < hi && i < ranges.size(); ++i) {
+      index_t first = ranges[i].first + (lo - offsets[i]);
+      index_t last = std::min(ranges[i].second, first + (hi - lo));
+      cb(first, last);
+      lo += last - first;
+    }
+  }
+};
+
+#endif
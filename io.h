@@ -4,6 +4,15 @@
 #include <exception>
 #include <fstream>
 #include <iostream>
+#include <string>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 class IOException : public std::exception {
   std::string msg;
@@ -14,11 +23,90 @@ public:
   }
 };
 
+// Read-only memory mapping of a whole file. Processes that map the same file
+// share its copy in the page cache, and nothing is read before it is used.
+class MappedFile {
+  void *addr;
+  size_t len;
+
+public:
+  explicit MappedFile(const std::string& fname) : addr(nullptr), len(0) {
+    int fd = open(fname.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+      if (fd >= 0)
+        close(fd);
+      throw IOException("Could not read file " + fname);
+    }
+    len = st.st_size;
+    if (len) {
+      addr = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+      if (addr == MAP_FAILED) {
+        close(fd);
+        throw IOException("Could not map file " + fname);
+      }
+    }
+    close(fd);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() {
+    if (len)
+      munmap(addr, len);
+  }
+
+  const unsigned char *data() const {
+    return (const unsigned char*)addr;
+  }
+
+  size_t size() const {
+    return len;
+  }
+};
+
 std::string read_file(std::string fname) {
-  std::ifstream f(fname, std::ios::binary);
-  if (!f.good())
-    throw IOException("Could not read file " + fname);
-  return std::string(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+  MappedFile f(fname);
+  return std::string(f.data(), f.data() + f.size());
+}
+
+// Start value of fnv1a()
+const uint64_t FNV_BASIS = 14695981039346656037ULL;
+
+// 64-bit FNV-1a of the n bytes at p, continuing from h. Fingerprints of
+// inputs that a search depends on feed their contents through it, starting
+// with FNV_BASIS.
+uint64_t fnv1a(uint64_t h, const void *p, size_t n) {
+  const unsigned char *b = (const unsigned char*)p;
+  for (size_t i = 0; i < n; ++i)
+    h = (h ^ b[i]) * 1099511628211ULL;
+  return h;
+}
+
+// Hex encoding for arbitrary bytes in line-based text formats
+std::string to_hex(const std::string& s) {
+  static const char digits[] = "0123456789abcdef";
+  std::string res;
+  for (unsigned char c : s) {
+    res += digits[c >> 4];
+    res += digits[c & 0xf];
+  }
+  return res;
+}
+
+// Whether s is the hex encoding of some bytes
+bool is_hex(const std::string& s) {
+  return s.size() % 2 == 0 && s.find_first_not_of("0123456789abcdefABCDEF") == std::string::npos;
+}
+
+std::string from_hex(const std::string& s) {
+  if (!is_hex(s))
+    throw IOException("Invalid hex string " + s.substr(0, 64));
+  std::string res;
+  for (size_t i = 0; i < s.size(); i += 2)
+    res += (char)std::stoi(s.substr(i, 2), nullptr, 16);
+  return res;
 }
 
 #endif
@@ -0,0 +1,164 @@
+#ifndef _KEYSPACE_H
+#define _KEYSPACE_H
+
+#include <string>
+#include <vector>
+
+#include "index.h"
+
+// Mixed-radix bijection between candidate indices and the strings matching a
+// pattern. Wildcard i ranges over alphabet(i) and the last wildcard is the
+// least significant digit, so consecutive indices differ in the fastest
+// changing position. Both the CPU and the OpenCL engine number candidates
+// this way.
+//
+// A reordered keyspace maps the digit of a wildcard to a character through a
+// permutation of its alphabet that depends on the character in front of it,
+// e.g. to try likely strings first. Digits still range over the same bases,
+// so the numbering stays a bijection.
+class Keyspace {
+  std::string pattern_str;
+  std::vector<int> positions;
+  std::vector<std::string> alphabets;
+  // Order of wildcard i after character c at orders[i * PREV + c], empty if
+  // the alphabets are used as they are
+  std::vector<std::string> orders;
+  index_t total;
+  bool overflow;
+
+public:
+  // Number of distinct characters in front of a wildcard, including NO_PREV
+  static const int PREV = 257;
+  // What is in front of a wildcard at the start of the string
+  static const int NO_PREV = 256;
+
+  Keyspace() : total(0), overflow(false) {}
+
+  Keyspace(const std::string& pattern,
+           const std::vector<int>& positions,
+           const std::vector<std::string>& alphabets)
+    : pattern_str(pattern), positions(positions), alphabets(alphabets)
+    , total(1), overflow(false)
+  {
+    for (auto& alph : alphabets) {
+      if (total > INDEX_MAX / alph.size())
+        overflow = true;
+      total *= alph.size();
+    }
+  }
+
+  const std::string& pattern() const {
+    return pattern_str;
+  }
+
+  int num_wildcards() const {
+    return positions.size();
+  }
+
+  int position(int i) const {
+    return positions[i];
+  }
+
+  const std::string& alphabet(int i) const {
+    return alphabets[i];
+  }
+
+  size_t base(int i) const {
+    return alphabets[i].size();
+  }
+
+  // The characters of wildcard i in the order of its digits, when prev is in
+  // front of it
+  const std::string& alphabet(int i, int prev) const {
+    return orders.empty() ? alphabets[i] : orders[i * PREV + prev];
+  }
+
+  bool reordered() const {
+    return !orders.empty();
+  }
+
+  // Makes order, a permutation of alphabet(i), the order of wildcard i after
+  // prev
+  void reorder(int i, int prev, const std::string& order) {
+    if (orders.empty()) {
+      for (int j = 0; j < num_wildcards(); ++j)
+        orders.insert(orders.end(), PREV, alphabets[j]);
+    }
+    orders[i * PREV + prev] = order;
+  }
+
+  // What is in front of wildcard i of the string in buf
+  int prev(int i, const unsigned char *buf) const {
+    return positions[i] > 0 ? buf[positions[i] - 1] : NO_PREV;
+  }
+
+  // The keyspace of the pattern with only its first n wildcards, the others
+  // removed. The orders of a reordered keyspace do not carry over.
+  Keyspace head(int n) const {
+    std::string p = pattern_str;
+    for (int i = num_wildcards() - 1; i >= n; --i)
+      p.erase(positions[i], 1);
+    return Keyspace(p, std::vector<int>(positions.begin(), positions.begin() + n),
+                    std::vector<std::string>(alphabets.begin(), alphabets.begin() + n));
+  }
+
+  // Whether size() does not fit into an index_t
+  bool overflows() const {
+    return overflow;
+  }
+
+  index_t size() const {
+    return total;
+  }
+
+  // Splits index into one digit per wildcard
+  void digits(index_t index, size_t *digits) const {
+    for (int i = num_wildcards() - 1; i >= 0; --i) {
+      digits[i] = index % base(i);
+      index /= base(i);
+    }
+  }
+
+  // Writes the wildcards of candidate index into buf, which holds the pattern
+  void decode(index_t index, unsigned char *buf) const {
+    if (reordered()) {
+      std::vector<size_t> d(num_wildcards());
+      digits(index, d.data());
+      for (int i = 0; i < num_wildcards(); ++i)
+        buf[positions[i]] = alphabet(i, prev(i, buf))[d[i]];
+      return;
+    }
+    for (int i = num_wildcards() - 1; i >= 0; --i) {
+      buf[positions[i]] = alphabets[i][index % base(i)];
+      index /= base(i);
+    }
+  }
+
+  std::string decode(index_t index) const {
+    std::string s = pattern_str;
+    decode(index, (unsigned char*)&s[0]);
+    return s;
+  }
+
+  // Inverse of decode(). Returns false if s does not match the pattern.
+  bool encode(const std::string& s, index_t& index) const {
+    if (s.size() != pattern_str.size())
+      return false;
+    index = 0;
+    for (int i = 0; i < num_wildcards(); ++i) {
+      size_t digit = alphabet(i, prev(i, (const unsigned char*)s.data())).find(s[positions[i]]);
+      if (digit == std::string::npos)
+        return false;
+      index = index * base(i) + digit;
+    }
+    for (size_t p = 0, i = 0; p < s.size(); ++p) {
+      if (i < positions.size() && positions[i] == (int)p)
+        ++i;
+      else if (s[p] != pattern_str[p])
+        return false;
+    }
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef _LEASES_H
+#define _LEASES_H
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "intervals.h"
+
+// Hands out the index range [first, last) in leases of the size that each
+// client asks for. A lease that is not renewed before its deadline expires and
+// its indices are leased again, so a crashed client only delays the search.
+// Not thread-safe.
+class LeaseTable {
+  struct Lease {
+    index_t lo, hi;
+    double deadline;
+  };
+  index_t first, last;
+  double timeout;
+  IntervalSet done;
+  std::map<size_t, Lease> leases;
+  size_t next_id;
+
+  void expire(double now) {
+    for (auto it = leases.begin(); it != leases.end(); ) {
+      if (it->second.deadline < now)
+        it = leases.erase(it);
+      else
+        ++it;
+    }
+  }
+
+public:
+  LeaseTable(index_t first, index_t last, const IntervalSet& done, double timeout)
+    : first(first), last(last), timeout(timeout), done(done), next_id(0) {}
+
+  // Leases at most count indices that are neither done nor leased. Returns
+  // false if there are none right now.
+  bool grant(size_t count, double now, size_t& id, index_t& lo, index_t& hi) {
+    expire(now);
+    IntervalSet busy = done;
+    for (auto& l : leases)
+      busy.add(l.second.lo, l.second.hi);
+    std::vector<Interval> free = busy.complement(first, last);
+    if (free.empty())
+      return false;
+    id = next_id++;
+    lo = free[0].first;
+    hi = lo + std::min<index_t>(std::max<size_t>(count, 1), free[0].second - lo);
+    leases[id] = Lease { lo, hi, now + timeout };
+    return true;
+  }
+
+  // Extends the deadline of a lease. Returns false if it already expired.
+  bool renew(size_t id, double now) {
+    auto it = leases.find(id);
+    if (it == leases.end())
+      return false;
+    it->second.deadline = now + timeout;
+    return true;
+  }
+
+  // Records that the indices [lo, hi) of lease id are done, even if it expired
+  // in the meantime. Returns the parts that were not done before.
+  std::vector<Interval> complete(size_t id, index_t lo, index_t hi) {
+    leases.erase(id);
+    std::vector<Interval> res = done.complement(std::max(lo, first), std::min(hi, last));
+    for (auto& i : res)
+      done.add(i.first, i.second);
+    return res;
+  }
+
+  bool finished() const {
+    return done.complement(first, last).empty();
+  }
+};
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef _MARKOV_H
+#define _MARKOV_H
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include <cstdint>
+
+#include "io.h"
+#include "keyspace.h"
+#include "wordlist.h"
+
+// Character statistics of a wordlist: how often every character occurs at
+// every position of a word, after every character (or at the start). They
+// order the alphabet of every wildcard so that likely strings come first.
+//
+// Only the counts that occur are stored, in a text file:
+//   crhash-markov 1
+//   count POS PREV CHAR N
+// with PREV = 256 at the start of a word. Positions from POSITIONS - 1 on
+// share their counts.
+//
+// The wildcards after the '*' of a wordlist pattern have no fixed position,
+// as they move with the length of the word. They are ordered by the counts
+// after prev summed over all positions instead.
+class MarkovModel {
+  static const size_t POSITIONS = 64;
+
+  std::map<uint32_t, uint64_t> counts; // by key(pos, prev, c)
+  std::map<uint32_t, uint64_t> totals; // by key(pos, 0, c), over all prev
+  std::map<uint32_t, uint64_t> anywhere; // by key(0, prev, c), over all pos
+
+  static uint32_t key(size_t pos, int prev, unsigned char c) {
+    return ((uint32_t)std::min(pos, POSITIONS - 1) * Keyspace::PREV + prev) * 256 + c;
+  }
+
+  static uint64_t lookup(const std::map<uint32_t, uint64_t>& m, uint32_t k) {
+    auto it = m.find(k);
+    return it == m.end() ? 0 : it->second;
+  }
+
+  void add(size_t pos, int prev, unsigned char c, uint64_t n) {
+    counts[key(pos, prev, c)] += n;
+    totals[key(pos, 0, c)] += n;
+    anywhere[key(0, prev, c)] += n;
+  }
+
+  // alphabet sorted by first[c], most first, then by second[c], and then by
+  // the order of alphabet
+  static std::string sorted(const std::string& alphabet, const uint64_t *first,
+                            const uint64_t *second) {
+    std::string res = alphabet;
+    std::stable_sort(res.begin(), res.end(), [&](unsigned char a, unsigned char b) {
+      return first[a] != first[b] ? first[a] > first[b] : second[a] > second[b];
+    });
+    return res;
+  }
+
+public:
+  void train(const Wordlist& words) {
+    const char *p = words.begin(), *word;
+    size_t len;
+    while (p < words.end()) {
+      Wordlist::next(p, words.end(), word, len);
+      for (size_t i = 0; i < len; ++i)
+        add(i, i ? (unsigned char)word[i - 1] : Keyspace::NO_PREV, word[i], 1);
+    }
+  }
+
+  void load(const std::string& fname) {
+    std::istringstream in(read_file(fname));
+    std::string magic, line;
+    int version;
+    if (!(in >> magic >> version) || magic != "crhash-markov" || version != 1)
+      throw IOException("Invalid Markov statistics " + fname);
+    counts.clear();
+    totals.clear();
+    anywhere.clear();
+    std::string cmd;
+    size_t pos;
+    int prev, c;
+    uint64_t n;
+    while (in >> cmd) {
+      if (cmd != "count" || !(in >> pos >> prev >> c >> n) || prev < 0
+          || prev >= Keyspace::PREV || c < 0 || c > 255)
+        throw IOException("Invalid Markov statistics " + fname);
+      add(pos, prev, c, n);
+    }
+  }
+
+  void save(const std::string& fname) const {
+    std::ofstream f(fname);
+    f << "crhash-markov 1\n";
+    for (auto& e : counts) {
+      uint32_t k = e.first;
+      f << "count " << k / 256 / Keyspace::PREV << " " << k / 256 % Keyspace::PREV
+        << " " << k % 256 << " " << e.second << "\n";
+    }
+    f.close();
+    if (!f.good())
+      throw IOException("Could not write file " + fname);
+  }
+
+  bool empty() const {
+    return counts.empty();
+  }
+
+  uint64_t fingerprint() const {
+    uint64_t h = FNV_BASIS;
+    for (auto& e : counts) {
+      h = fnv1a(h, &e.first, sizeof(e.first));
+      h = fnv1a(h, &e.second, sizeof(e.second));
+    }
+    return h;
+  }
+
+  // alphabet sorted by how often its characters occur at pos after prev, most
+  // often first. Ties go by the counts at pos after any character, and then
+  // by the order of alphabet.
+  std::string order(size_t pos, int prev, const std::string& alphabet) const {
+    uint64_t after[256], any[256];
+    for (unsigned char c : alphabet) {
+      after[c] = lookup(counts, key(pos, prev, c));
+      any[c] = lookup(totals, key(pos, 0, c));
+    }
+    return sorted(alphabet, after, any);
+  }
+
+  // alphabet sorted by how often its characters occur after prev at any
+  // position. Ties go by the order of alphabet.
+  std::string order(int prev, const std::string& alphabet) const {
+    uint64_t after[256], none[256] = {};
+    for (unsigned char c : alphabet)
+      after[c] = lookup(anywhere, key(0, prev, c));
+    return sorted(alphabet, after, none);
+  }
+
+  // Orders the wildcards of keyspace in front of wildcard floating by their
+  // position in the pattern, and the others by the counts at any position
+  void apply(Keyspace& keyspace, int floating) const {
+    for (int i = 0; i < keyspace.num_wildcards(); ++i) {
+      for (int prev = 0; prev < Keyspace::PREV; ++prev) {
+        const std::string& alph = keyspace.alphabet(i);
+        keyspace.reorder(i, prev, i < floating ? order(keyspace.position(i), prev, alph)
+                                               : order(prev, alph));
+      }
+    }
+  }
+
+  void apply(Keyspace& keyspace) const {
+    apply(keyspace, keyspace.num_wildcards());
+  }
+};
+
+#endif
@@ -0,0 +1,210 @@
+#ifndef _MASKS_H
+#define _MASKS_H
+
+#include <algorithm>
+#include <bitset>
+#include <string>
+#include <vector>
+
+#include <cstdint>
+
+#include "index.h"
+#include "io.h"
+#include "keyspace.h"
+
+// Several keyspaces, e.g. the lengths of an --increment run, numbered one
+// after the other: index first(i) + j of the list is candidate j of mask i.
+// A single range of the list thus covers all masks, so threads, progress,
+// --skip/--limit and checkpoints work across them as they do for one mask.
+//
+// add_new() only adds the strings that the list does not have yet. A mask is
+// a box, the product of the characters that each of its positions can take,
+// and the difference of two boxes is a union of at most one disjoint box per
+// position, each again a keyspace with narrower alphabets.
+class MaskList {
+  typedef std::bitset<256> CharSet;
+  typedef std::vector<CharSet> Box; // the characters of every position
+
+  // Most keyspaces that a mask is split into. Beyond that, the overlap with
+  // an earlier mask is kept, as ever smaller pieces cost more than they save.
+  static const size_t MAX_PIECES = 256;
+
+  std::vector<Keyspace> masks;
+  std::vector<index_t> firsts; // first index of every mask, then the total
+  std::vector<Box> boxes; // of every mask passed to add_new()
+  bool overflow;
+
+  static Box box(const Keyspace& ks) {
+    const std::string& pattern = ks.pattern();
+    Box b(pattern.size());
+    for (size_t p = 0; p < pattern.size(); ++p)
+      b[p].set((unsigned char)pattern[p]);
+    for (int i = 0; i < ks.num_wildcards(); ++i) {
+      b[ks.position(i)].reset();
+      for (unsigned char c : ks.alphabet(i))
+        b[ks.position(i)].set(c);
+    }
+    return b;
+  }
+
+  // Whether b is inside a
+  static bool inside(const Box& b, const Box& a) {
+    if (b.size() != a.size())
+      return false;
+    for (size_t p = 0; p < b.size(); ++p) {
+      if ((b[p] & ~a[p]).any())
+        return false;
+    }
+    return true;
+  }
+
+  // Appends the parts of b outside of a to out, as disjoint boxes
+  static void subtract(const Box& b, const Box& a, std::vector<Box>& out) {
+    if (b.size() != a.size()) {
+      out.push_back(b);
+      return;
+    }
+    for (size_t p = 0; p < b.size(); ++p) {
+      if ((b[p] & a[p]).none()) {
+        out.push_back(b);
+        return;
+      }
+    }
+    Box rest = b;
+    for (size_t p = 0; p < b.size(); ++p) {
+      CharSet outside = rest[p] & ~a[p];
+      if (outside.any()) {
+        out.push_back(rest);
+        out.back()[p] = outside;
+      }
+      rest[p] &= a[p];
+    }
+  }
+
+  // The strings of ks in b, with the characters of every wildcard in the
+  // order of ks
+  static Keyspace narrow(const Keyspace& ks, const Box& b) {
+    std::vector<int> positions;
+    std::vector<std::string> alphabets;
+    for (int i = 0; i < ks.num_wildcards(); ++i) {
+      positions.push_back(ks.position(i));
+      alphabets.emplace_back();
+      for (unsigned char c : ks.alphabet(i)) {
+        if (b[ks.position(i)][c])
+          alphabets.back() += c;
+      }
+    }
+    return Keyspace(ks.pattern(), positions, alphabets);
+  }
+
+public:
+  MaskList() : firsts(1, 0), overflow(false) {}
+
+  void add(const Keyspace& mask) {
+    if (mask.overflows() || firsts.back() > INDEX_MAX - mask.size())
+      overflow = true;
+    masks.push_back(mask);
+    firsts.push_back(firsts.back() + mask.size());
+  }
+
+  // Adds the strings of mask that none of the masks passed to add_new()
+  // before has, as one or more disjoint keyspaces. Unless trim, only skips
+  // masks inside one of them and keeps partial overlaps. Returns the number
+  // of strings of mask that were left out.
+  index_t add_new(const Keyspace& mask, bool trim) {
+    Box b = box(mask);
+    std::vector<Box> pieces(1, b), next;
+    for (auto& a : boxes) {
+      if (!trim) {
+        if (inside(b, a))
+          pieces.clear();
+        continue;
+      }
+      next.clear();
+      for (auto& piece : pieces)
+        subtract(piece, a, next);
+      if (next.size() <= MAX_PIECES)
+        pieces.swap(next);
+    }
+    boxes.push_back(b);
+    index_t added = 0;
+    for (auto& piece : pieces) {
+      add(narrow(mask, piece));
+      added += masks.back().size();
+    }
+    return mask.size() - added;
+  }
+
+  size_t count() const {
+    return masks.size();
+  }
+
+  const Keyspace& operator[](size_t i) const {
+    return masks[i];
+  }
+
+  Keyspace& operator[](size_t i) {
+    return masks[i];
+  }
+
+  index_t first(size_t i) const {
+    return firsts[i];
+  }
+
+  // Whether size() does not fit into an index_t
+  bool overflows() const {
+    return overflow;
+  }
+
+  index_t size() const {
+    return firsts.back();
+  }
+
+  // The mask that index falls into
+  size_t find(index_t index) const {
+    return std::upper_bound(firsts.begin(), firsts.end(), index) - firsts.begin() - 1;
+  }
+
+  // Calls cb(i, first, last) for the parts of [first, last) in every mask i
+  // it overlaps, with first and last relative to the mask
+  template <typename F>
+  void split(index_t first, index_t last, F cb) const {
+    for (size_t i = find(first); first < last; ++i) {
+      index_t end = std::min(last, firsts[i + 1]);
+      if (end > first)
+        cb(i, first - firsts[i], end - firsts[i]);
+      first = end;
+    }
+  }
+
+  // Hashes the patterns and alphabets, each followed by its length so that
+  // the strings can not run into each other
+  uint64_t fingerprint() const {
+    uint64_t h = FNV_BASIS;
+    auto feed = [&](const std::string& s) {
+      size_t len = s.size();
+      h = fnv1a(h, s.data(), len);
+      h = fnv1a(h, &len, sizeof(len));
+    };
+    for (auto& mask : masks) {
+      feed(mask.pattern());
+      for (int i = 0; i < mask.num_wildcards(); ++i)
+        feed(mask.alphabet(i));
+    }
+    return h;
+  }
+
+  // Index of s in the first mask that it matches. Returns false if it
+  // matches none.
+  bool encode(const std::string& s, index_t& index) const {
+    for (size_t i = 0; i < masks.size(); ++i) {
+      if (masks[i].encode(s, index)) {
+        index += firsts[i];
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+#endif
@@ -159,7 +159,7 @@ __kernel void GenerateAndCheck(
     const __global uint *prefix, uint prefix_len,
     const __global uint *suffix, uint suffix_len,
     uint lo, uint hi, uint sz,
-    uint offset,
+    ulong offset,
     __global uchar *results
     /*__global uint *debug*/
     )
@@ -171,12 +171,22 @@ __kernel void GenerateAndCheck(
   uint p = 0;
   for (; p < prefix_len; ++p)
     PUTCHAR(buf, p, GETCHAR_GLOBAL(prefix, p));
-  uint num = id + offset;
+  // Same numbering as the host: the last wildcard is the least significant
+  // digit. Switch to 32-bit arithmetic as soon as the rest fits.
+  ulong num = id + offset;
   uint base = hi - lo + 1;
-  for (; p < prefix_len + sz; ++p) {
-    PUTCHAR(buf, p, num % base + lo);
-    num /= base;
+  for (uint i = 1; i <= sz; ++i) {
+    uint digit;
+    if (num >> 32) {
+      digit = num % base;
+      num /= base;
+    } else {
+      digit = (uint)num % base;
+      num = (uint)num / base;
+    }
+    PUTCHAR(buf, prefix_len + sz - i, digit + lo);
   }
+  p = prefix_len + sz;
   for (uint j = 0; j < suffix_len; ++j) {
     PUTCHAR(buf, p, GETCHAR_GLOBAL(suffix, j));
     ++p;
@@ -25,7 +25,10 @@
 #include <cstring>
 #include "md5.h"
 
-void md5_compress(uint32_t state[4], const uint32_t block[16]) {
+// Runs md5_compress() starting at the given round-1 step, with a, b, c, d
+// holding the intermediate registers before that step.
+static inline void md5_compress_from(uint32_t state[4], const uint32_t block[16],
+    uint32_t a, uint32_t b, uint32_t c, uint32_t d, int step) {
   #define ROUND0(a, b, c, d, k, s, t)  ROUND_TAIL(a, b, d ^ (b & (c ^ d)), k, s, t)
   #define ROUND1(a, b, c, d, k, s, t)  ROUND_TAIL(a, b, c ^ (d & (b ^ c)), k, s, t)
   #define ROUND2(a, b, c, d, k, s, t)  ROUND_TAIL(a, b, b ^ c ^ d        , k, s, t)
@@ -34,27 +37,25 @@ void md5_compress(uint32_t state[4], const uint32_t block[16]) {
     a += (expr) + UINT32_C(t) + block[k];  \
     a = b + (a << s | a >> (32 - s));
 
-  uint32_t a = state[0];
-  uint32_t b = state[1];
-  uint32_t c = state[2];
-  uint32_t d = state[3];
+  switch (step) {
+  case  0: ROUND0(a, b, c, d,  0,  7, 0xD76AA478)
+  case  1: ROUND0(d, a, b, c,  1, 12, 0xE8C7B756)
+  case  2: ROUND0(c, d, a, b,  2, 17, 0x242070DB)
+  case  3: ROUND0(b, c, d, a,  3, 22, 0xC1BDCEEE)
+  case  4: ROUND0(a, b, c, d,  4,  7, 0xF57C0FAF)
+  case  5: ROUND0(d, a, b, c,  5, 12, 0x4787C62A)
+  case  6: ROUND0(c, d, a, b,  6, 17, 0xA8304613)
+  case  7: ROUND0(b, c, d, a,  7, 22, 0xFD469501)
+  case  8: ROUND0(a, b, c, d,  8,  7, 0x698098D8)
+  case  9: ROUND0(d, a, b, c,  9, 12, 0x8B44F7AF)
+  case 10: ROUND0(c, d, a, b, 10, 17, 0xFFFF5BB1)
+  case 11: ROUND0(b, c, d, a, 11, 22, 0x895CD7BE)
+  case 12: ROUND0(a, b, c, d, 12,  7, 0x6B901122)
+  case 13: ROUND0(d, a, b, c, 13, 12, 0xFD987193)
+  case 14: ROUND0(c, d, a, b, 14, 17, 0xA679438E)
+  case 15: ROUND0(b, c, d, a, 15, 22, 0x49B40821)
+  }
 
-  ROUND0(a, b, c, d,  0,  7, 0xD76AA478)
-  ROUND0(d, a, b, c,  1, 12, 0xE8C7B756)
-  ROUND0(c, d, a, b,  2, 17, 0x242070DB)
-  ROUND0(b, c, d, a,  3, 22, 0xC1BDCEEE)
-  ROUND0(a, b, c, d,  4,  7, 0xF57C0FAF)
-  ROUND0(d, a, b, c,  5, 12, 0x4787C62A)
-  ROUND0(c, d, a, b,  6, 17, 0xA8304613)
-  ROUND0(b, c, d, a,  7, 22, 0xFD469501)
-  ROUND0(a, b, c, d,  8,  7, 0x698098D8)
-  ROUND0(d, a, b, c,  9, 12, 0x8B44F7AF)
-  ROUND0(c, d, a, b, 10, 17, 0xFFFF5BB1)
-  ROUND0(b, c, d, a, 11, 22, 0x895CD7BE)
-  ROUND0(a, b, c, d, 12,  7, 0x6B901122)
-  ROUND0(d, a, b, c, 13, 12, 0xFD987193)
-  ROUND0(c, d, a, b, 14, 17, 0xA679438E)
-  ROUND0(b, c, d, a, 15, 22, 0x49B40821)
   ROUND1(a, b, c, d,  1,  5, 0xF61E2562)
   ROUND1(d, a, b, c,  6,  9, 0xC040B340)
   ROUND1(c, d, a, b, 11, 14, 0x265E5A51)
@@ -110,11 +111,70 @@ void md5_compress(uint32_t state[4], const uint32_t block[16]) {
   state[3] += d;
 }
 
+void md5_compress(uint32_t state[4], const uint32_t block[16]) {
+  md5_compress_from(state, block, state[0], state[1], state[2], state[3], 0);
+}
+
+// Computes the intermediate registers after the first `steps` round-1 steps,
+// which only depend on block words 0..steps-1.
+void md5_round1_prefix(const uint32_t state[4], const uint32_t block[16], int steps, uint32_t mid[4]) {
+  #define PREFIX_STEP(a, b, c, d, k, s, t)  \
+    if (steps == k) goto done;              \
+    ROUND0(a, b, c, d, k, s, t)
+
+  uint32_t a = state[0];
+  uint32_t b = state[1];
+  uint32_t c = state[2];
+  uint32_t d = state[3];
+
+  PREFIX_STEP(a, b, c, d,  0,  7, 0xD76AA478)
+  PREFIX_STEP(d, a, b, c,  1, 12, 0xE8C7B756)
+  PREFIX_STEP(c, d, a, b,  2, 17, 0x242070DB)
+  PREFIX_STEP(b, c, d, a,  3, 22, 0xC1BDCEEE)
+  PREFIX_STEP(a, b, c, d,  4,  7, 0xF57C0FAF)
+  PREFIX_STEP(d, a, b, c,  5, 12, 0x4787C62A)
+  PREFIX_STEP(c, d, a, b,  6, 17, 0xA8304613)
+  PREFIX_STEP(b, c, d, a,  7, 22, 0xFD469501)
+  PREFIX_STEP(a, b, c, d,  8,  7, 0x698098D8)
+  PREFIX_STEP(d, a, b, c,  9, 12, 0x8B44F7AF)
+  PREFIX_STEP(c, d, a, b, 10, 17, 0xFFFF5BB1)
+  PREFIX_STEP(b, c, d, a, 11, 22, 0x895CD7BE)
+  PREFIX_STEP(a, b, c, d, 12,  7, 0x6B901122)
+  PREFIX_STEP(d, a, b, c, 13, 12, 0xFD987193)
+  PREFIX_STEP(c, d, a, b, 14, 17, 0xA679438E)
+  PREFIX_STEP(b, c, d, a, 15, 22, 0x49B40821)
+
+done:
+  mid[0] = a;
+  mid[1] = b;
+  mid[2] = c;
+  mid[3] = d;
+}
+
+// Finishes a compression whose first `step` steps md5_round1_prefix() cached in mid.
+void md5_compress_resume(uint32_t state[4], const uint32_t block[16], const uint32_t mid[4], int step) {
+  md5_compress_from(state, block, mid[0], mid[1], mid[2], mid[3], step);
+}
+
+void md5_init(uint32_t state[4]) {
+  state[0] = UINT32_C(0x67452301);
+  state[1] = UINT32_C(0xEFCDAB89);
+  state[2] = UINT32_C(0x98BADCFE);
+  state[3] = UINT32_C(0x10325476);
+}
+
+// Pads a single-block message in place. The first len bytes of block hold the
+// message, len must be <= 55.
+void md5_pad_block(uint32_t block[16], uint32_t len) {
+  uint8_t *byteBlock = (uint8_t *)block;  // Type-punning
+  byteBlock[len] = 0x80;
+  memset(byteBlock + len + 1, 0, 55 - len);
+  block[14] = len << 3;
+  block[15] = 0;
+}
+
 void md5_hash(const uint8_t *message, uint32_t len, uint32_t hash[4]) {
-  hash[0] = UINT32_C(0x67452301);
-  hash[1] = UINT32_C(0xEFCDAB89);
-  hash[2] = UINT32_C(0x98BADCFE);
-  hash[3] = UINT32_C(0x10325476);
+  md5_init(hash);
 
   uint32_t i;
   for (i = 0; len - i >= 64; i += 64)
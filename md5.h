@@ -4,6 +4,22 @@
 #include <stdint.h>
 
 void md5_compress(uint32_t state[4], const uint32_t block[16]);
+void md5_round1_prefix(const uint32_t state[4], const uint32_t block[16], int steps, uint32_t mid[4]);
+void md5_compress_resume(uint32_t state[4], const uint32_t block[16], const uint32_t mid[4], int step);
+void md5_init(uint32_t state[4]);
+void md5_pad_block(uint32_t block[16], uint32_t len);
 void md5_hash(const uint8_t *message, uint32_t len, uint32_t hash[4]);
 
+// Multi-buffer variants, see md5_simd.cpp for the SoA layout
+#ifdef __AVX2__
+void md5_compress_x8(uint32_t state[4 * 8], const uint32_t block[16 * 8]);
+void md5_compress_x8_resume(uint32_t state[4 * 8], const uint32_t block[16 * 8],
+                            const uint32_t mid[4 * 8], int step);
+#endif
+#ifdef __AVX512F__
+void md5_compress_x16(uint32_t state[4 * 16], const uint32_t block[16 * 16]);
+void md5_compress_x16_resume(uint32_t state[4 * 16], const uint32_t block[16 * 16],
+                             const uint32_t mid[4 * 16], int step);
+#endif
+
 #endif
@@ -0,0 +1,166 @@
+/*
+ * Multi-buffer MD5 compression, hashing several independent blocks per call
+ * with SIMD instructions. Blocks and states are stored in SoA layout: word i
+ * of lane j lives at block[i * lanes + j], and likewise for the state. The
+ * kernels are only available if the compiler targets the respective ISA.
+ */
+#include <cstdint>
+#include <immintrin.h>
+#include "md5.h"
+
+// The steps of md5_compress(). Round 1 is spelled out as case labels, so that
+// a compression can resume at any round-1 step like md5_compress_resume().
+#define MD5_ROUND0_CASES(R0) \
+  case  0: R0(a, b, c, d,  0,  7, 0xD76AA478)  \
+  case  1: R0(d, a, b, c,  1, 12, 0xE8C7B756)  \
+  case  2: R0(c, d, a, b,  2, 17, 0x242070DB)  \
+  case  3: R0(b, c, d, a,  3, 22, 0xC1BDCEEE)  \
+  case  4: R0(a, b, c, d,  4,  7, 0xF57C0FAF)  \
+  case  5: R0(d, a, b, c,  5, 12, 0x4787C62A)  \
+  case  6: R0(c, d, a, b,  6, 17, 0xA8304613)  \
+  case  7: R0(b, c, d, a,  7, 22, 0xFD469501)  \
+  case  8: R0(a, b, c, d,  8,  7, 0x698098D8)  \
+  case  9: R0(d, a, b, c,  9, 12, 0x8B44F7AF)  \
+  case 10: R0(c, d, a, b, 10, 17, 0xFFFF5BB1)  \
+  case 11: R0(b, c, d, a, 11, 22, 0x895CD7BE)  \
+  case 12: R0(a, b, c, d, 12,  7, 0x6B901122)  \
+  case 13: R0(d, a, b, c, 13, 12, 0xFD987193)  \
+  case 14: R0(c, d, a, b, 14, 17, 0xA679438E)  \
+  case 15: R0(b, c, d, a, 15, 22, 0x49B40821)
+
+#define MD5_ROUND123_STEPS(R1, R2, R3) \
+  R1(a, b, c, d,  1,  5, 0xF61E2562)  \
+  R1(d, a, b, c,  6,  9, 0xC040B340)  \
+  R1(c, d, a, b, 11, 14, 0x265E5A51)  \
+  R1(b, c, d, a,  0, 20, 0xE9B6C7AA)  \
+  R1(a, b, c, d,  5,  5, 0xD62F105D)  \
+  R1(d, a, b, c, 10,  9, 0x02441453)  \
+  R1(c, d, a, b, 15, 14, 0xD8A1E681)  \
+  R1(b, c, d, a,  4, 20, 0xE7D3FBC8)  \
+  R1(a, b, c, d,  9,  5, 0x21E1CDE6)  \
+  R1(d, a, b, c, 14,  9, 0xC33707D6)  \
+  R1(c, d, a, b,  3, 14, 0xF4D50D87)  \
+  R1(b, c, d, a,  8, 20, 0x455A14ED)  \
+  R1(a, b, c, d, 13,  5, 0xA9E3E905)  \
+  R1(d, a, b, c,  2,  9, 0xFCEFA3F8)  \
+  R1(c, d, a, b,  7, 14, 0x676F02D9)  \
+  R1(b, c, d, a, 12, 20, 0x8D2A4C8A)  \
+  R2(a, b, c, d,  5,  4, 0xFFFA3942)  \
+  R2(d, a, b, c,  8, 11, 0x8771F681)  \
+  R2(c, d, a, b, 11, 16, 0x6D9D6122)  \
+  R2(b, c, d, a, 14, 23, 0xFDE5380C)  \
+  R2(a, b, c, d,  1,  4, 0xA4BEEA44)  \
+  R2(d, a, b, c,  4, 11, 0x4BDECFA9)  \
+  R2(c, d, a, b,  7, 16, 0xF6BB4B60)  \
+  R2(b, c, d, a, 10, 23, 0xBEBFBC70)  \
+  R2(a, b, c, d, 13,  4, 0x289B7EC6)  \
+  R2(d, a, b, c,  0, 11, 0xEAA127FA)  \
+  R2(c, d, a, b,  3, 16, 0xD4EF3085)  \
+  R2(b, c, d, a,  6, 23, 0x04881D05)  \
+  R2(a, b, c, d,  9,  4, 0xD9D4D039)  \
+  R2(d, a, b, c, 12, 11, 0xE6DB99E5)  \
+  R2(c, d, a, b, 15, 16, 0x1FA27CF8)  \
+  R2(b, c, d, a,  2, 23, 0xC4AC5665)  \
+  R3(a, b, c, d,  0,  6, 0xF4292244)  \
+  R3(d, a, b, c,  7, 10, 0x432AFF97)  \
+  R3(c, d, a, b, 14, 15, 0xAB9423A7)  \
+  R3(b, c, d, a,  5, 21, 0xFC93A039)  \
+  R3(a, b, c, d, 12,  6, 0x655B59C3)  \
+  R3(d, a, b, c,  3, 10, 0x8F0CCC92)  \
+  R3(c, d, a, b, 10, 15, 0xFFEFF47D)  \
+  R3(b, c, d, a,  1, 21, 0x85845DD1)  \
+  R3(a, b, c, d,  8,  6, 0x6FA87E4F)  \
+  R3(d, a, b, c, 15, 10, 0xFE2CE6E0)  \
+  R3(c, d, a, b,  6, 15, 0xA3014314)  \
+  R3(b, c, d, a, 13, 21, 0x4E0811A1)  \
+  R3(a, b, c, d,  4,  6, 0xF7537E82)  \
+  R3(d, a, b, c, 11, 10, 0xBD3AF235)  \
+  R3(c, d, a, b,  2, 15, 0x2AD7D2BB)  \
+  R3(b, c, d, a,  9, 21, 0xEB86D391)
+
+#ifdef __AVX2__
+static inline void md5_compress_x8_from(uint32_t state[4 * 8], const uint32_t block[16 * 8],
+    __m256i a, __m256i b, __m256i c, __m256i d, int step) {
+  #define X8_ADD(x, y)  _mm256_add_epi32(x, y)
+  #define X8_AND(x, y)  _mm256_and_si256(x, y)
+  #define X8_OR(x, y)   _mm256_or_si256(x, y)
+  #define X8_XOR(x, y)  _mm256_xor_si256(x, y)
+  #define X8_NOT(x)     _mm256_xor_si256(x, _mm256_set1_epi32(-1))
+  #define X8_ROTL(x, s) X8_OR(_mm256_slli_epi32(x, s), _mm256_srli_epi32(x, 32 - (s)))
+  #define X8_LOAD(k)    _mm256_loadu_si256((const __m256i *)(block + 8 * (k)))
+  #define X8_ROUND0(a, b, c, d, k, s, t)  X8_TAIL(a, b, X8_XOR(d, X8_AND(b, X8_XOR(c, d))), k, s, t)
+  #define X8_ROUND1(a, b, c, d, k, s, t)  X8_TAIL(a, b, X8_XOR(c, X8_AND(d, X8_XOR(b, c))), k, s, t)
+  #define X8_ROUND2(a, b, c, d, k, s, t)  X8_TAIL(a, b, X8_XOR(X8_XOR(b, c), d)          , k, s, t)
+  #define X8_ROUND3(a, b, c, d, k, s, t)  X8_TAIL(a, b, X8_XOR(c, X8_OR(b, X8_NOT(d)))    , k, s, t)
+  #define X8_TAIL(a, b, expr, k, s, t)                                             \
+    a = X8_ADD(a, X8_ADD(expr, X8_ADD(_mm256_set1_epi32((int)UINT32_C(t)), X8_LOAD(k)))); \
+    a = X8_ADD(b, X8_ROTL(a, s));
+
+  switch (step) {
+  MD5_ROUND0_CASES(X8_ROUND0)
+  }
+  MD5_ROUND123_STEPS(X8_ROUND1, X8_ROUND2, X8_ROUND3)
+
+  __m256i *st = (__m256i *)state;
+  _mm256_storeu_si256(st + 0, X8_ADD(_mm256_loadu_si256(st + 0), a));
+  _mm256_storeu_si256(st + 1, X8_ADD(_mm256_loadu_si256(st + 1), b));
+  _mm256_storeu_si256(st + 2, X8_ADD(_mm256_loadu_si256(st + 2), c));
+  _mm256_storeu_si256(st + 3, X8_ADD(_mm256_loadu_si256(st + 3), d));
+}
+
+void md5_compress_x8(uint32_t state[4 * 8], const uint32_t block[16 * 8]) {
+  const __m256i *st = (const __m256i *)state;
+  md5_compress_x8_from(state, block,
+      _mm256_loadu_si256(st + 0), _mm256_loadu_si256(st + 1),
+      _mm256_loadu_si256(st + 2), _mm256_loadu_si256(st + 3), 0);
+}
+
+void md5_compress_x8_resume(uint32_t state[4 * 8], const uint32_t block[16 * 8],
+                            const uint32_t mid[4 * 8], int step) {
+  const __m256i *m = (const __m256i *)mid;
+  md5_compress_x8_from(state, block,
+      _mm256_loadu_si256(m + 0), _mm256_loadu_si256(m + 1),
+      _mm256_loadu_si256(m + 2), _mm256_loadu_si256(m + 3), step);
+}
+#endif
+
+#ifdef __AVX512F__
+// The boolean functions map onto single vpternlogd instructions. Their
+// immediates are the truth tables over (b, c, d) = (0xf0, 0xcc, 0xaa).
+static inline void md5_compress_x16_from(uint32_t state[4 * 16], const uint32_t block[16 * 16],
+    __m512i a, __m512i b, __m512i c, __m512i d, int step) {
+  #define X16_ADD(x, y)          _mm512_add_epi32(x, y)
+  #define X16_TERN(x, y, z, imm) _mm512_ternarylogic_epi32(x, y, z, imm)
+  #define X16_LOAD(k)            _mm512_loadu_si512((const void *)(block + 16 * (k)))
+  #define X16_ROUND0(a, b, c, d, k, s, t)  X16_TAIL(a, b, X16_TERN(b, c, d, 0xca), k, s, t)
+  #define X16_ROUND1(a, b, c, d, k, s, t)  X16_TAIL(a, b, X16_TERN(b, c, d, 0xe4), k, s, t)
+  #define X16_ROUND2(a, b, c, d, k, s, t)  X16_TAIL(a, b, X16_TERN(b, c, d, 0x96), k, s, t)
+  #define X16_ROUND3(a, b, c, d, k, s, t)  X16_TAIL(a, b, X16_TERN(b, c, d, 0x39), k, s, t)
+  #define X16_TAIL(a, b, expr, k, s, t)                                             \
+    a = X16_ADD(a, X16_ADD(expr, X16_ADD(_mm512_set1_epi32((int)UINT32_C(t)), X16_LOAD(k)))); \
+    a = X16_ADD(b, _mm512_rol_epi32(a, s));
+
+  switch (step) {
+  MD5_ROUND0_CASES(X16_ROUND0)
+  }
+  MD5_ROUND123_STEPS(X16_ROUND1, X16_ROUND2, X16_ROUND3)
+
+  _mm512_storeu_si512(state + 0 * 16, X16_ADD(_mm512_loadu_si512(state + 0 * 16), a));
+  _mm512_storeu_si512(state + 1 * 16, X16_ADD(_mm512_loadu_si512(state + 1 * 16), b));
+  _mm512_storeu_si512(state + 2 * 16, X16_ADD(_mm512_loadu_si512(state + 2 * 16), c));
+  _mm512_storeu_si512(state + 3 * 16, X16_ADD(_mm512_loadu_si512(state + 3 * 16), d));
+}
+
+void md5_compress_x16(uint32_t state[4 * 16], const uint32_t block[16 * 16]) {
+  md5_compress_x16_from(state, block,
+      _mm512_loadu_si512(state + 0 * 16), _mm512_loadu_si512(state + 1 * 16),
+      _mm512_loadu_si512(state + 2 * 16), _mm512_loadu_si512(state + 3 * 16), 0);
+}
+
+void md5_compress_x16_resume(uint32_t state[4 * 16], const uint32_t block[16 * 16],
+                             const uint32_t mid[4 * 16], int step) {
+  md5_compress_x16_from(state, block,
+      _mm512_loadu_si512(mid + 0 * 16), _mm512_loadu_si512(mid + 1 * 16),
+      _mm512_loadu_si512(mid + 2 * 16), _mm512_loadu_si512(mid + 3 * 16), step);
+}
+#endif
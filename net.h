@@ -0,0 +1,132 @@
+#ifndef _NET_H
+#define _NET_H
+
+#include <string>
+
+#include <cerrno>
+#include <cstring>
+
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "io.h"
+
+// Minimal line-oriented stream sockets. An address is either "unix:PATH" for a
+// Unix domain socket or "HOST:PORT" for TCP.
+
+// Creates a socket for addr and hands it to op (bind or connect). Returns the
+// socket, throws an IOException naming what when op fails for all candidates.
+template <typename F>
+int open_socket(const std::string& addr, const std::string& what, F op) {
+  if (addr.compare(0, 5, "unix:") == 0) {
+    sockaddr_un sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    std::string path = addr.substr(5);
+    if (path.empty() || path.size() >= sizeof(sa.sun_path))
+      throw IOException("Invalid socket path " + path);
+    strcpy(sa.sun_path, path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && op(fd, (sockaddr*)&sa, sizeof(sa)) == 0)
+      return fd;
+    if (fd >= 0)
+      close(fd);
+    throw IOException("Could not " + what + " " + addr + ": " + strerror(errno));
+  }
+  size_t colon = addr.rfind(':');
+  if (colon == std::string::npos)
+    throw IOException("Invalid address " + addr + ", expected unix:PATH or HOST:PORT");
+  std::string host = addr.substr(0, colon), port = addr.substr(colon + 1);
+  addrinfo hints, *res;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &res) != 0)
+    throw IOException("Could not resolve " + addr);
+  for (addrinfo *ai = res; ai; ai = ai->ai_next) {
+    int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0)
+      continue;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (op(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+      freeaddrinfo(res);
+      return fd;
+    }
+    close(fd);
+  }
+  freeaddrinfo(res);
+  throw IOException("Could not " + what + " " + addr + ": " + strerror(errno));
+}
+
+// Returns a socket listening on addr. A stale Unix socket file is replaced.
+int listen_on(const std::string& addr) {
+  if (addr.compare(0, 5, "unix:") == 0)
+    unlink(addr.substr(5).c_str());
+  int fd = open_socket(addr, "listen on", [](int fd, const sockaddr *sa, socklen_t len) {
+    return bind(fd, sa, len);
+  });
+  if (listen(fd, 64) != 0) {
+    close(fd);
+    throw IOException("Could not listen on " + addr + ": " + strerror(errno));
+  }
+  return fd;
+}
+
+int connect_to(const std::string& addr) {
+  return open_socket(addr, "connect to", connect);
+}
+
+// Waits at most timeout_ms for a connection on the listening socket fd.
+// Returns the new socket, or -1 on timeout.
+int accept_on(int fd, int timeout_ms) {
+  pollfd p = { fd, POLLIN, 0 };
+  if (poll(&p, 1, timeout_ms) <= 0)
+    return -1;
+  return accept(fd, nullptr, nullptr);
+}
+
+class Connection {
+  int fd;
+  std::string buf;
+
+public:
+  explicit Connection(int fd) : fd(fd) {}
+  Connection(const Connection&) = delete;
+  Connection& operator=(const Connection&) = delete;
+
+  ~Connection() {
+    close(fd);
+  }
+
+  void send_line(const std::string& line) {
+    std::string data = line + "\n";
+    for (size_t off = 0; off < data.size(); ) {
+      ssize_t n = send(fd, data.c_str() + off, data.size() - off, MSG_NOSIGNAL);
+      if (n <= 0)
+        throw IOException("Connection lost");
+      off += n;
+    }
+  }
+
+  // Reads the next line without its terminator. Returns false on EOF.
+  bool recv_line(std::string& line) {
+    size_t nl;
+    while ((nl = buf.find('\n')) == std::string::npos) {
+      char tmp[4096];
+      ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+      if (n <= 0)
+        return false;
+      buf.append(tmp, n);
+    }
+    line = buf.substr(0, nl);
+    buf.erase(0, nl + 1);
+    return true;
+  }
+};
+
+#endif
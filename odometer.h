@@ -0,0 +1,96 @@
+#ifndef _ODOMETER_H
+#define _ODOMETER_H
+
+#include <string>
+#include <vector>
+
+#include "keyspace.h"
+
+// Enumerates the strings of a keyspace in place. The candidate lives in a
+// caller-provided buffer that already holds the constant characters of the
+// pattern, and every step only rewrites the wildcard positions that changed.
+// Wildcard 0 is the most significant digit, the last wildcard changes fastest.
+// In a reordered keyspace, the wildcards behind one that changed are rewritten
+// too, as the character in front of them may have changed.
+class Odometer {
+  unsigned char *buf;
+  std::vector<int> positions;
+  std::vector<const std::string*> alphabets; // current order of every wildcard
+  std::vector<size_t> digits;
+  const Keyspace& keyspace;
+  int n;
+
+  // Rewrites the wildcards from first on, in order
+  void rewrite(int first) {
+    for (int i = first; i < n; ++i) {
+      int prev = positions[i] > 0 ? buf[positions[i] - 1] : Keyspace::NO_PREV;
+      alphabets[i] = &keyspace.alphabet(i, prev);
+      buf[positions[i]] = (*alphabets[i])[digits[i]];
+    }
+  }
+
+public:
+  Odometer(unsigned char *buf, const Keyspace& keyspace)
+    : buf(buf), digits(keyspace.num_wildcards())
+    , keyspace(keyspace), n(keyspace.num_wildcards())
+  {
+    for (int i = 0; i < n; ++i) {
+      positions.push_back(keyspace.position(i));
+      alphabets.push_back(&keyspace.alphabet(i));
+    }
+    seek(0);
+  }
+
+  int size() const {
+    return n;
+  }
+
+  size_t base(int i) const {
+    return alphabets[i]->size();
+  }
+
+  size_t digit(int i) const {
+    return digits[i];
+  }
+
+  void set(int i, size_t digit) {
+    digits[i] = digit;
+    buf[positions[i]] = (*alphabets[i])[digit];
+    if (keyspace.reordered())
+      rewrite(i + 1);
+  }
+
+  // Moves wildcards first.. to by characters after their position in the
+  // keyspace, for a pattern that grew in front of them. Takes effect with the
+  // next seek().
+  void shift(int first, int by) {
+    for (int i = first; i < n; ++i)
+      positions[i] = keyspace.position(i) + by;
+  }
+
+  // Jumps to the candidate with the given index
+  void seek(index_t index) {
+    keyspace.digits(index, digits.data());
+    rewrite(0);
+  }
+
+  // Advances to the next candidate. Returns the index of the most significant
+  // wildcard that changed, or -1 after wrapping around to the first candidate.
+  int next() {
+    for (int i = n - 1; i >= 0; --i) {
+      if (++digits[i] < alphabets[i]->size()) {
+        buf[positions[i]] = (*alphabets[i])[digits[i]];
+        if (keyspace.reordered() && i + 1 < n)
+          rewrite(i + 1);
+        return i;
+      }
+      digits[i] = 0;
+      buf[positions[i]] = (*alphabets[i])[0];
+    }
+    if (keyspace.reordered())
+      rewrite(0);
+    return -1;
+  }
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef _PROGRESS_H
+#define _PROGRESS_H
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include <cstdint>
+
+#include "aligned.h"
+#include "index.h"
+
+// Counts tested strings without sharing a cache line between threads. Every
+// slot has a single writer, which only needs plain loads and stores instead
+// of a locked read-modify-write. Readers sum all slots.
+//
+// The counts are index_t wide, as the slot of a coordinator counts the
+// strings of all its workers. A slot keeps the two halves in a seqlock, so a
+// reader never sees a carry half done.
+class ProgressCounters {
+  struct alignas(64) Slot {
+    std::atomic<uint64_t> seq, lo, hi;
+  };
+  AlignedArray<Slot> slots;
+  int num_slots;
+
+public:
+  ProgressCounters() : num_slots(0) {}
+
+  // At least one slot, which the engines other than the CPU workers use
+  explicit ProgressCounters(int n)
+    : slots(make_aligned_array<Slot>(std::max(n, 1))), num_slots(std::max(n, 1)) {}
+
+  // Must only be called by the owner of slot t
+  void add(int t, index_t count) {
+    Slot& s = slots[t];
+    uint64_t seq = s.seq.load(std::memory_order_relaxed);
+    index_t n = ((index_t)s.hi.load(std::memory_order_relaxed) << 64
+                 | s.lo.load(std::memory_order_relaxed)) + count;
+    s.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s.lo.store((uint64_t)n, std::memory_order_relaxed);
+    s.hi.store((uint64_t)(n >> 64), std::memory_order_relaxed);
+    s.seq.store(seq + 2, std::memory_order_release);
+  }
+
+  index_t sum() const {
+    index_t res = 0;
+    for (int i = 0; i < num_slots; ++i) {
+      const Slot& s = slots[i];
+      uint64_t seq, lo, hi;
+      do {
+        seq = s.seq.load(std::memory_order_acquire);
+        lo = s.lo.load(std::memory_order_relaxed);
+        hi = s.hi.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+      } while ((seq & 1) || seq != s.seq.load(std::memory_order_relaxed));
+      res += (index_t)hi << 64 | lo;
+    }
+    return res;
+  }
+};
+
+#endif
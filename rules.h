@@ -0,0 +1,385 @@
+#ifndef _RULES_H
+#define _RULES_H
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <cstdint>
+#include <cstring>
+
+#include "io.h"
+
+// Word mangling rules in the syntax of hashcat rule files: one rule per line,
+// each a sequence of single-character functions with their arguments, e.g.
+// "c $1 $2" capitalizes a word and appends "12". Positions are 0-9 and A-Z
+// for 10-35. Lines that start with # are comments.
+//
+// Every rule is compiled once into bytecode: the function character followed
+// by its arguments, with positions already decoded and no-ops and spaces
+// dropped. apply() runs it in place on a caller-provided buffer, so mangling
+// a word never allocates. Functions that would grow a word beyond the buffer,
+// or that refer to positions beyond its end, leave the word unchanged.
+class RuleSet {
+  std::vector<unsigned char> code; // all programs, back to back
+  std::vector<uint32_t> starts; // rule i is code[starts[i], starts[i + 1])
+
+  // Which arguments a function takes: N for a position, X for a character
+  static const char *signature(char op) {
+    switch (op) {
+    case 'l': case 'u': case 'c': case 'C': case 't': case 'E': case 'r': case 'd':
+    case 'f': case '{': case '}': case '[': case ']': case 'q': case 'k': case 'K':
+      return "";
+    case 'T': case 'p': case 'D': case '\'': case 'z': case 'Z': case 'L': case 'R':
+    case '+': case '-': case '.': case ',': case 'y': case 'Y':
+      return "N";
+    case '$': case '^': case '@': case 'e':
+      return "X";
+    case 'x': case 'O': case '*':
+      return "NN";
+    case 'i': case 'o':
+      return "NX";
+    case 's':
+      return "XX";
+    default:
+      return nullptr;
+    }
+  }
+
+  static int position(char c) {
+    if (c >= '0' && c <= '9')
+      return c - '0';
+    if (c >= 'A' && c <= 'Z')
+      return c - 'A' + 10;
+    return -1;
+  }
+
+  static unsigned char lower(unsigned char c) {
+    return c >= 'A' && c <= 'Z' ? c + 32 : c;
+  }
+
+  static unsigned char upper(unsigned char c) {
+    return c >= 'a' && c <= 'z' ? c - 32 : c;
+  }
+
+  static unsigned char toggle(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ? c ^ 32 : c;
+  }
+
+  // Lowercases w and uppercases its first character and those after sep
+  static void title(unsigned char *w, size_t len, unsigned char sep) {
+    for (size_t k = 0; k < len; ++k)
+      w[k] = k == 0 || w[k - 1] == sep ? upper(w[k]) : lower(w[k]);
+  }
+
+public:
+  // The longest word that rules make, like hashcat's
+  static const size_t MAX_LEN = 256;
+
+  // A set with just the rule that leaves words unchanged
+  RuleSet() : starts(2, 0) {}
+
+  // Appends the bytecode of rule to out. Returns an error message, or an
+  // empty string on success.
+  static std::string compile(const std::string& rule, std::vector<unsigned char>& out) {
+    for (size_t i = 0; i < rule.size(); ) {
+      char op = rule[i++];
+      if (op == ' ' || op == '\t' || op == ':')
+        continue;
+      const char *sig = signature(op);
+      if (!sig)
+        return std::string("unsupported function ") + op;
+      out.push_back(op);
+      for (; *sig; ++sig) {
+        if (i >= rule.size())
+          return std::string("missing argument of ") + op;
+        char c = rule[i++];
+        if (*sig == 'N' && position(c) < 0)
+          return std::string("invalid position ") + c;
+        out.push_back(*sig == 'N' ? position(c) : c);
+      }
+    }
+    return "";
+  }
+
+  void load(const std::string& fname) {
+    std::istringstream in(read_file(fname));
+    std::string line;
+    code.clear();
+    starts.assign(1, 0);
+    for (size_t nr = 1; getline(in, line); ++nr) {
+      if (!line.empty() && line.back() == '\r')
+        line.pop_back();
+      if (line.empty() || line[0] == '#')
+        continue;
+      std::string err = compile(line, code);
+      if (!err.empty())
+        throw IOException(fname + ":" + std::to_string(nr) + ": " + err);
+      starts.push_back(code.size());
+    }
+    if (starts.size() < 2)
+      throw IOException("No rules in " + fname);
+  }
+
+  size_t size() const {
+    return starts.size() - 1;
+  }
+
+  uint64_t fingerprint() const {
+    uint64_t h = fnv1a(FNV_BASIS, starts.data(), starts.size() * sizeof(starts[0]));
+    return fnv1a(h, code.data(), code.size());
+  }
+
+  // Applies rule i to the word of length len in w, which has room for cap
+  // bytes. Returns the new length.
+  size_t apply(size_t i, unsigned char *w, size_t len, size_t cap) const {
+    const unsigned char *pc = code.data() + starts[i], *end = code.data() + starts[i + 1];
+    cap = std::min(cap, MAX_LEN);
+    while (pc < end) {
+      unsigned char op = *pc++;
+      switch (op) {
+      case 'l':
+        for (size_t k = 0; k < len; ++k)
+          w[k] = lower(w[k]);
+        break;
+      case 'u':
+        for (size_t k = 0; k < len; ++k)
+          w[k] = upper(w[k]);
+        break;
+      case 'c':
+        for (size_t k = 0; k < len; ++k)
+          w[k] = k ? lower(w[k]) : upper(w[k]);
+        break;
+      case 'C':
+        for (size_t k = 0; k < len; ++k)
+          w[k] = k ? upper(w[k]) : lower(w[k]);
+        break;
+      case 't':
+        for (size_t k = 0; k < len; ++k)
+          w[k] = toggle(w[k]);
+        break;
+      case 'T': {
+        size_t n = *pc++;
+        if (n < len)
+          w[n] = toggle(w[n]);
+        break;
+      }
+      case 'E':
+        title(w, len, ' ');
+        break;
+      case 'e':
+        title(w, len, *pc++);
+        break;
+      case 'r':
+        std::reverse(w, w + len);
+        break;
+      case 'd':
+        if (2 * len <= cap) {
+          memcpy(w + len, w, len);
+          len *= 2;
+        }
+        break;
+      case 'p': {
+        size_t n = *pc++;
+        if (len * (n + 1) <= cap) {
+          for (size_t j = 1; j <= n; ++j)
+            memcpy(w + j * len, w, len);
+          len *= n + 1;
+        }
+        break;
+      }
+      case 'f':
+        if (2 * len <= cap) {
+          for (size_t k = 0; k < len; ++k)
+            w[len + k] = w[len - 1 - k];
+          len *= 2;
+        }
+        break;
+      case '{':
+        if (len)
+          std::rotate(w, w + 1, w + len);
+        break;
+      case '}':
+        if (len)
+          std::rotate(w, w + len - 1, w + len);
+        break;
+      case '$': {
+        unsigned char c = *pc++;
+        if (len < cap)
+          w[len++] = c;
+        break;
+      }
+      case '^': {
+        unsigned char c = *pc++;
+        if (len < cap) {
+          memmove(w + 1, w, len);
+          w[0] = c;
+          len++;
+        }
+        break;
+      }
+      case '[':
+        if (len) {
+          memmove(w, w + 1, len - 1);
+          len--;
+        }
+        break;
+      case ']':
+        if (len)
+          len--;
+        break;
+      case 'D': {
+        size_t n = *pc++;
+        if (n < len) {
+          memmove(w + n, w + n + 1, len - n - 1);
+          len--;
+        }
+        break;
+      }
+      case 'x': {
+        size_t n = pc[0], m = pc[1];
+        pc += 2;
+        if (n + m <= len) {
+          memmove(w, w + n, m);
+          len = m;
+        }
+        break;
+      }
+      case 'O': {
+        size_t n = pc[0], m = pc[1];
+        pc += 2;
+        if (n + m <= len) {
+          memmove(w + n, w + n + m, len - n - m);
+          len -= m;
+        }
+        break;
+      }
+      case 'i': {
+        size_t n = pc[0];
+        unsigned char c = pc[1];
+        pc += 2;
+        if (n <= len && len < cap) {
+          memmove(w + n + 1, w + n, len - n);
+          w[n] = c;
+          len++;
+        }
+        break;
+      }
+      case 'o': {
+        size_t n = pc[0];
+        unsigned char c = pc[1];
+        pc += 2;
+        if (n < len)
+          w[n] = c;
+        break;
+      }
+      case '\'': {
+        size_t n = *pc++;
+        if (n < len)
+          len = n;
+        break;
+      }
+      case 's': {
+        unsigned char x = pc[0], y = pc[1];
+        pc += 2;
+        for (size_t k = 0; k < len; ++k) {
+          if (w[k] == x)
+            w[k] = y;
+        }
+        break;
+      }
+      case '@': {
+        unsigned char x = *pc++;
+        size_t j = 0;
+        for (size_t k = 0; k < len; ++k) {
+          if (w[k] != x)
+            w[j++] = w[k];
+        }
+        len = j;
+        break;
+      }
+      case 'z': {
+        size_t n = *pc++;
+        if (len && len + n <= cap) {
+          memmove(w + n, w, len);
+          memset(w, w[n], n);
+          len += n;
+        }
+        break;
+      }
+      case 'Z': {
+        size_t n = *pc++;
+        if (len && len + n <= cap) {
+          memset(w + len, w[len - 1], n);
+          len += n;
+        }
+        break;
+      }
+      case 'q':
+        if (2 * len <= cap) {
+          // Back to front, so every character is read before it is overwritten
+          for (size_t k = len; k-- > 0; )
+            w[2 * k] = w[2 * k + 1] = w[k];
+          len *= 2;
+        }
+        break;
+      case 'k':
+        if (len >= 2)
+          std::swap(w[0], w[1]);
+        break;
+      case 'K':
+        if (len >= 2)
+          std::swap(w[len - 2], w[len - 1]);
+        break;
+      case '*': {
+        size_t n = pc[0], m = pc[1];
+        pc += 2;
+        if (n < len && m < len)
+          std::swap(w[n], w[m]);
+        break;
+      }
+      case 'L': case 'R': case '+': case '-': {
+        size_t n = *pc++;
+        if (n < len) {
+          w[n] = op == 'L' ? w[n] << 1 : op == 'R' ? w[n] >> 1
+               : op == '+' ? w[n] + 1 : w[n] - 1;
+        }
+        break;
+      }
+      case '.': {
+        size_t n = *pc++;
+        if (n + 1 < len)
+          w[n] = w[n + 1];
+        break;
+      }
+      case ',': {
+        size_t n = *pc++;
+        if (n >= 1 && n < len)
+          w[n] = w[n - 1];
+        break;
+      }
+      case 'y': {
+        size_t n = *pc++;
+        if (n <= len && len + n <= cap) {
+          memmove(w + n, w, len);
+          memcpy(w, w + n, n);
+          len += n;
+        }
+        break;
+      }
+      case 'Y': {
+        size_t n = *pc++;
+        if (n <= len && len + n <= cap) {
+          memcpy(w + len, w + len - n, n);
+          len += n;
+        }
+        break;
+      }
+      }
+    }
+    return len;
+  }
+};
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "aligned.h"
+#include "index.h"
+
+// Distributes the index range [first, last) over a number of workers. Every
+// worker starts out owning an equal share and takes fine-grained chunks from
+// its front. A worker whose share runs dry steals the back half of the largest
+// remaining share, so all of them stay busy until the range is exhausted.
+// There is always at least one worker, so a non-empty range never ends up
+// without an owner.
+class WorkStealingScheduler {
+  struct alignas(64) Share {
+    std::mutex mx;
+    index_t lo, hi;
+  };
+  AlignedArray<Share> shares;
+  int num_workers;
+  size_t chunk;
+
+  // Moves the back half of the largest share to worker t's (empty) share
+  bool steal(int t) {
+    for (;;) {
+      int victim = -1;
+      index_t best = 0;
+      for (int i = 0; i < num_workers; ++i) {
+        std::lock_guard<std::mutex> lg(shares[i].mx);
+        if (shares[i].hi - shares[i].lo > best) {
+          best = shares[i].hi - shares[i].lo;
+          victim = i;
+        }
+      }
+      if (victim < 0)
+        return false;
+      index_t lo, hi;
+      {
+        std::lock_guard<std::mutex> lg(shares[victim].mx);
+        Share& v = shares[victim];
+        if (v.lo == v.hi)
+          continue;
+        hi = v.hi;
+        lo = v.hi - v.lo <= chunk ? v.lo : v.lo + (v.hi - v.lo) / 2;
+        v.hi = lo;
+      }
+      std::lock_guard<std::mutex> lg(shares[t].mx);
+      shares[t].lo = lo;
+      shares[t].hi = hi;
+      return true;
+    }
+  }
+
+public:
+  WorkStealingScheduler(index_t first, index_t last, int workers, size_t chunk)
+    : shares(make_aligned_array<Share>(std::max(workers, 1)))
+    , num_workers(std::max(workers, 1)), chunk(chunk)
+  {
+    index_t total = last - first;
+    for (int t = 0; t < num_workers; ++t) {
+      shares[t].lo = first + total / num_workers * t + std::min<index_t>(t, total % num_workers);
+      shares[t].hi = shares[t].lo + total / num_workers + (t < total % num_workers);
+    }
+  }
+
+  int workers() const {
+    return num_workers;
+  }
+
+  index_t initial_lo(int t) const {
+    return shares[t].lo;
+  }
+
+  index_t initial_hi(int t) const {
+    return shares[t].hi;
+  }
+
+  // Assigns the next chunk [lo, hi) to worker t. Returns false once there is
+  // no work left anywhere.
+  bool next(int t, index_t& lo, index_t& hi) {
+    for (;;) {
+      {
+        std::lock_guard<std::mutex> lg(shares[t].mx);
+        Share& s = shares[t];
+        if (s.lo < s.hi) {
+          lo = s.lo;
+          hi = std::min(s.hi, s.lo + chunk);
+          s.lo = hi;
+          return true;
+        }
+      }
+      if (!steal(t))
+        return false;
+    }
+  }
+};
+
+#endif
@@ -115,8 +115,133 @@ void SHA256::final(unsigned char *digest)
 }
 
 void sha256_hash(const uint8_t *message, uint32_t len, unsigned char hash[SHA256::DIGEST_SIZE]) {
+    if (len <= 55) {
+        sha256_hash_block(message, len, hash);
+        return;
+    }
     SHA256 ctx = SHA256();
     ctx.init();
     ctx.update( (unsigned char*)message, len);
     ctx.final(hash);
 }
+
+void sha256_init(uint32_t state[8])
+{
+    state[0] = 0x6a09e667;
+    state[1] = 0xbb67ae85;
+    state[2] = 0x3c6ef372;
+    state[3] = 0xa54ff53a;
+    state[4] = 0x510e527f;
+    state[5] = 0x9b05688c;
+    state[6] = 0x1f83d9ab;
+    state[7] = 0x5be0cd19;
+}
+
+// Pads a single-block message in place. The first len bytes of block hold the
+// message, len must be <= 55.
+void sha256_pad_block(uint32_t block[16], uint32_t len)
+{
+    unsigned char *bytes = (unsigned char *) block;
+    bytes[len] = 0x80;
+    memset(bytes + len + 1, 0, 63 - len);
+    bytes[62] = (unsigned char) (len >> 5);
+    bytes[63] = (unsigned char) (len << 3);
+}
+
+#define SHA256_ROUND(a, b, c, d, e, f, g, h, i)                          \
+    t1 = h + SHA256_F2(e) + SHA2_CH(e, f, g) + SHA256::sha256_k[i] + w[i]; \
+    t2 = SHA256_F1(a) + SHA2_MAJ(a, b, c);                               \
+    d += t1;                                                            \
+    h = t1 + t2;
+#define SHA256_CASE_ROUND(a, b, c, d, e, f, g, h, i) \
+    case i: SHA256_ROUND(a, b, c, d, e, f, g, h, i)
+#define SHA256_PREFIX_ROUND(a, b, c, d, e, f, g, h, i) \
+    if (steps == i) goto done;                       \
+    SHA256_ROUND(a, b, c, d, e, f, g, h, i)
+
+// Runs a compression starting at round `step`, with wv holding the working
+// variables before that round.
+static inline void sha256_compress_from(uint32_t state[8], const uint32_t block[16],
+                                        const uint32_t wv[8], int step)
+{
+    uint32_t w[64];
+    uint32_t t1, t2;
+    int j;
+    for (j = 0; j < 16; j++) {
+        w[j] = __builtin_bswap32(block[j]);
+    }
+    for (j = 16; j < 64; j++) {
+        w[j] =  SHA256_F4(w[j -  2]) + w[j -  7] + SHA256_F3(w[j - 15]) + w[j - 16];
+    }
+    uint32_t a = wv[0], b = wv[1], c = wv[2], d = wv[3];
+    uint32_t e = wv[4], f = wv[5], g = wv[6], h = wv[7];
+    switch (step) {
+    SHA256_ROUNDS_0_15(SHA256_CASE_ROUND)
+    }
+    for (j = 16; j < 64; j += 8) {
+        SHA256_EIGHT_ROUNDS(SHA256_ROUND, j)
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+void sha256_compress(uint32_t state[8], const uint32_t block[16])
+{
+    sha256_compress_from(state, block, state, 0);
+}
+
+// Computes the working variables after the first `steps` rounds, which only
+// depend on block words 0..steps-1.
+void sha256_round_prefix(const uint32_t state[8], const uint32_t block[16], int steps, uint32_t mid[8])
+{
+    uint32_t w[16];
+    uint32_t t1, t2;
+    for (int j = 0; j < 16; j++) {
+        w[j] = __builtin_bswap32(block[j]);
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    SHA256_ROUNDS_0_15(SHA256_PREFIX_ROUND)
+done:
+    mid[0] = a;
+    mid[1] = b;
+    mid[2] = c;
+    mid[3] = d;
+    mid[4] = e;
+    mid[5] = f;
+    mid[6] = g;
+    mid[7] = h;
+}
+
+// Finishes a compression whose first `step` rounds sha256_round_prefix() cached in mid.
+void sha256_compress_resume(uint32_t state[8], const uint32_t block[16], const uint32_t mid[8], int step)
+{
+    sha256_compress_from(state, block, mid, step);
+}
+
+void sha256_digest(const uint32_t state[8], unsigned char digest[SHA256::DIGEST_SIZE])
+{
+    for (int i = 0; i < 8; i++) {
+        digest[(i << 2) + 0] = (unsigned char) (state[i] >> 24);
+        digest[(i << 2) + 1] = (unsigned char) (state[i] >> 16);
+        digest[(i << 2) + 2] = (unsigned char) (state[i] >>  8);
+        digest[(i << 2) + 3] = (unsigned char) (state[i]      );
+    }
+}
+
+void sha256_hash_block(const uint8_t *message, uint32_t len, unsigned char hash[SHA256::DIGEST_SIZE])
+{
+    uint32_t block[16];
+    uint32_t state[8];
+    memcpy(block, message, len);
+    sha256_pad_block(block, len);
+    sha256_init(state);
+    sha256_compress(state, block);
+    sha256_digest(state, hash);
+}
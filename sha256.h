@@ -36,6 +36,7 @@
  */
 #pragma once
 
+#include <stdint.h>
 #include <string>
 
 class SHA256
@@ -45,9 +46,9 @@ protected:
     typedef unsigned int uint32;
     typedef unsigned long long uint64;
 
-    const static uint32 sha256_k[];
     static const unsigned int SHA224_256_BLOCK_SIZE = (512/8);
 public:
+    const static uint32 sha256_k[];
     void init();
     void update(const unsigned char *message, unsigned int len);
     void final(unsigned char *digest);
@@ -63,6 +64,57 @@ protected:
 
 void sha256_hash(const uint8_t *message, uint32_t len, unsigned char hash[SHA256::DIGEST_SIZE]);
 
+// Single-block API. Blocks hold the message bytes as they are laid out in
+// memory, states are host-order words. See sha256_simd.cpp for the
+// multi-buffer variants.
+void sha256_init(uint32_t state[8]);
+void sha256_pad_block(uint32_t block[16], uint32_t len);
+void sha256_compress(uint32_t state[8], const uint32_t block[16]);
+void sha256_round_prefix(const uint32_t state[8], const uint32_t block[16], int steps, uint32_t mid[8]);
+void sha256_compress_resume(uint32_t state[8], const uint32_t block[16], const uint32_t mid[8], int step);
+void sha256_digest(const uint32_t state[8], unsigned char digest[SHA256::DIGEST_SIZE]);
+void sha256_hash_block(const uint8_t *message, uint32_t len, unsigned char hash[SHA256::DIGEST_SIZE]);
+
+#ifdef __AVX2__
+void sha256_compress_x8(uint32_t state[8 * 8], const uint32_t block[16 * 8]);
+void sha256_compress_x8_resume(uint32_t state[8 * 8], const uint32_t block[16 * 8],
+                               const uint32_t mid[8 * 8], int step);
+#endif
+#ifdef __AVX512F__
+void sha256_compress_x16(uint32_t state[8 * 16], const uint32_t block[16 * 16]);
+void sha256_compress_x16_resume(uint32_t state[8 * 16], const uint32_t block[16 * 16],
+                                const uint32_t mid[8 * 16], int step);
+#endif
+
+// Round i works on the variables rotated right by i % 8. Rounds 0..15 consume
+// the message words in order, which lets compressions resume at any of them.
+#define SHA256_ROUNDS_0_15(R) \
+    R(a, b, c, d, e, f, g, h,  0)  \
+    R(h, a, b, c, d, e, f, g,  1)  \
+    R(g, h, a, b, c, d, e, f,  2)  \
+    R(f, g, h, a, b, c, d, e,  3)  \
+    R(e, f, g, h, a, b, c, d,  4)  \
+    R(d, e, f, g, h, a, b, c,  5)  \
+    R(c, d, e, f, g, h, a, b,  6)  \
+    R(b, c, d, e, f, g, h, a,  7)  \
+    R(a, b, c, d, e, f, g, h,  8)  \
+    R(h, a, b, c, d, e, f, g,  9)  \
+    R(g, h, a, b, c, d, e, f, 10)  \
+    R(f, g, h, a, b, c, d, e, 11)  \
+    R(e, f, g, h, a, b, c, d, 12)  \
+    R(d, e, f, g, h, a, b, c, 13)  \
+    R(c, d, e, f, g, h, a, b, 14)  \
+    R(b, c, d, e, f, g, h, a, 15)
+#define SHA256_EIGHT_ROUNDS(R, i) \
+    R(a, b, c, d, e, f, g, h, (i) + 0)  \
+    R(h, a, b, c, d, e, f, g, (i) + 1)  \
+    R(g, h, a, b, c, d, e, f, (i) + 2)  \
+    R(f, g, h, a, b, c, d, e, (i) + 3)  \
+    R(e, f, g, h, a, b, c, d, (i) + 4)  \
+    R(d, e, f, g, h, a, b, c, (i) + 5)  \
+    R(c, d, e, f, g, h, a, b, (i) + 6)  \
+    R(b, c, d, e, f, g, h, a, (i) + 7)
+
 #define SHA2_SHFR(x, n)    (x >> n)
 #define SHA2_ROTR(x, n)   ((x >> n) | (x << ((sizeof(x) << 3) - n)))
 #define SHA2_ROTL(x, n)   ((x << n) | (x >> ((sizeof(x) << 3) - n)))
@@ -0,0 +1,136 @@
+/*
+ * Multi-buffer SHA-256 compression, hashing several independent blocks per
+ * call with SIMD instructions. Like md5_simd.cpp, blocks and states are stored
+ * in SoA layout: word i of lane j lives at block[i * lanes + j]. Blocks hold
+ * the message bytes as laid out in memory, the byte swap happens on load.
+ */
+#include <cstdint>
+#include <immintrin.h>
+#include "sha256.h"
+
+// The kernel is written once against a small set of vector operations, which
+// every instruction set provides in its own struct.
+template <typename O>
+static inline void sha256_compress_simd(uint32_t *state, const uint32_t *block,
+                                        const uint32_t *wv, int step)
+{
+    typedef typename O::V V;
+    const int L = O::lanes;
+    V w[16];
+    for (int j = 0; j < 16; j++) {
+        w[j] = O::bswap(O::load(block + j * L));
+    }
+    V a = O::load(wv + 0 * L), b = O::load(wv + 1 * L), c = O::load(wv + 2 * L), d = O::load(wv + 3 * L);
+    V e = O::load(wv + 4 * L), f = O::load(wv + 5 * L), g = O::load(wv + 6 * L), h = O::load(wv + 7 * L);
+
+    #define SIMD_ROUND(a, b, c, d, e, f, g, h, i)                                         \
+    {                                                                                   \
+        V t1 = O::add(O::add(h, O::sigma1(e)),                                          \
+                      O::add(O::ch(e, f, g), O::add(O::set1(SHA256::sha256_k[i]), w[(i) & 15]))); \
+        V t2 = O::add(O::sigma0(a), O::maj(a, b, c));                                   \
+        d = O::add(d, t1);                                                              \
+        h = O::add(t1, t2);                                                             \
+    }
+    #define SIMD_CASE_ROUND(a, b, c, d, e, f, g, h, i) \
+    case i: SIMD_ROUND(a, b, c, d, e, f, g, h, i)
+    #define SIMD_SCHEDULE_ROUND(a, b, c, d, e, f, g, h, i)                         \
+        w[(i) & 15] = O::add(O::add(O::gamma1(w[((i) - 2) & 15]), w[((i) - 7) & 15]), \
+                             O::add(O::gamma0(w[((i) - 15) & 15]), w[(i) & 15]));  \
+        SIMD_ROUND(a, b, c, d, e, f, g, h, i)
+
+    switch (step) {
+    SHA256_ROUNDS_0_15(SIMD_CASE_ROUND)
+    }
+    for (int j = 16; j < 64; j += 8) {
+        SHA256_EIGHT_ROUNDS(SIMD_SCHEDULE_ROUND, j)
+    }
+
+    V *st[8] = { &a, &b, &c, &d, &e, &f, &g, &h };
+    for (int j = 0; j < 8; j++) {
+        O::store(state + j * L, O::add(O::load(state + j * L), *st[j]));
+    }
+}
+
+#ifdef __AVX2__
+struct AVX2Ops {
+    typedef __m256i V;
+    static const int lanes = 8;
+
+    static V load(const uint32_t *p) { return _mm256_loadu_si256((const __m256i *) p); }
+    static void store(uint32_t *p, V x) { _mm256_storeu_si256((__m256i *) p, x); }
+    static V set1(uint32_t x) { return _mm256_set1_epi32((int) x); }
+    static V add(V x, V y) { return _mm256_add_epi32(x, y); }
+    static V bswap(V x) {
+        const __m256i mask = _mm256_setr_epi8(
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        return _mm256_shuffle_epi8(x, mask);
+    }
+    template <int n> static V rotr(V x) {
+        return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+    }
+    static V xor3(V x, V y, V z) { return _mm256_xor_si256(_mm256_xor_si256(x, y), z); }
+    static V ch(V x, V y, V z) { return _mm256_xor_si256(z, _mm256_and_si256(x, _mm256_xor_si256(y, z))); }
+    static V maj(V x, V y, V z) {
+        return _mm256_or_si256(_mm256_and_si256(x, y), _mm256_and_si256(z, _mm256_or_si256(x, y)));
+    }
+    static V sigma0(V x) { return xor3(rotr<2>(x), rotr<13>(x), rotr<22>(x)); }
+    static V sigma1(V x) { return xor3(rotr<6>(x), rotr<11>(x), rotr<25>(x)); }
+    static V gamma0(V x) { return xor3(rotr<7>(x), rotr<18>(x), _mm256_srli_epi32(x, 3)); }
+    static V gamma1(V x) { return xor3(rotr<17>(x), rotr<19>(x), _mm256_srli_epi32(x, 10)); }
+};
+
+void sha256_compress_x8(uint32_t state[8 * 8], const uint32_t block[16 * 8])
+{
+    sha256_compress_simd<AVX2Ops>(state, block, state, 0);
+}
+
+void sha256_compress_x8_resume(uint32_t state[8 * 8], const uint32_t block[16 * 8],
+                               const uint32_t mid[8 * 8], int step)
+{
+    sha256_compress_simd<AVX2Ops>(state, block, mid, step);
+}
+#endif
+
+#ifdef __AVX512F__
+// Ch, Maj and the three-way XORs are single vpternlogd instructions, the
+// rotates are vprord.
+struct AVX512Ops {
+    typedef __m512i V;
+    static const int lanes = 16;
+
+    static V load(const uint32_t *p) { return _mm512_loadu_si512((const void *) p); }
+    static void store(uint32_t *p, V x) { _mm512_storeu_si512((void *) p, x); }
+    static V set1(uint32_t x) { return _mm512_set1_epi32((int) x); }
+    static V add(V x, V y) { return _mm512_add_epi32(x, y); }
+    static V bswap(V x) {
+#ifdef __AVX512BW__
+        const __m512i mask = _mm512_broadcast_i32x4(_mm_setr_epi8(
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12));
+        return _mm512_shuffle_epi8(x, mask);
+#else
+        return _mm512_ternarylogic_epi32(_mm512_ror_epi32(x, 8), _mm512_rol_epi32(x, 8),
+                                         _mm512_set1_epi32(0xff00ff00), 0xe4);
+#endif
+    }
+    template <int n> static V rotr(V x) { return _mm512_ror_epi32(x, n); }
+    static V xor3(V x, V y, V z) { return _mm512_ternarylogic_epi32(x, y, z, 0x96); }
+    static V ch(V x, V y, V z) { return _mm512_ternarylogic_epi32(x, y, z, 0xca); }
+    static V maj(V x, V y, V z) { return _mm512_ternarylogic_epi32(x, y, z, 0xe8); }
+    static V sigma0(V x) { return xor3(rotr<2>(x), rotr<13>(x), rotr<22>(x)); }
+    static V sigma1(V x) { return xor3(rotr<6>(x), rotr<11>(x), rotr<25>(x)); }
+    static V gamma0(V x) { return xor3(rotr<7>(x), rotr<18>(x), _mm512_srli_epi32(x, 3)); }
+    static V gamma1(V x) { return xor3(rotr<17>(x), rotr<19>(x), _mm512_srli_epi32(x, 10)); }
+};
+
+void sha256_compress_x16(uint32_t state[8 * 16], const uint32_t block[16 * 16])
+{
+    sha256_compress_simd<AVX512Ops>(state, block, state, 0);
+}
+
+void sha256_compress_x16_resume(uint32_t state[8 * 16], const uint32_t block[16 * 16],
+                                const uint32_t mid[8 * 16], int step)
+{
+    sha256_compress_simd<AVX512Ops>(state, block, mid, step);
+}
+#endif
@@ -0,0 +1,49 @@
+#ifndef _SPSC_H
+#define _SPSC_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <utility>
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+// The indices only grow, so the queue is full when they are capacity apart.
+// They live on separate cache lines, each written by one side only.
+template <typename T>
+class SpscQueue {
+  std::unique_ptr<T[]> items;
+  size_t mask;
+  alignas(64) std::atomic<size_t> head; // next item to pop
+  alignas(64) std::atomic<size_t> tail; // next slot to push to
+
+public:
+  // capacity must be a power of two
+  explicit SpscQueue(size_t capacity)
+    : items(new T[capacity]), mask(capacity - 1), head(0), tail(0) {}
+
+  bool try_push(T& x) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) > mask)
+      return false;
+    items[t & mask] = std::move(x);
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Waits for the consumer while the queue is full
+  void push(T& x) {
+    while (!try_push(x))
+      std::this_thread::yield();
+  }
+
+  bool pop(T& x) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire))
+      return false;
+    x = std::move(items[h & mask]);
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+};
+
+#endif
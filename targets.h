@@ -0,0 +1,432 @@
+#ifndef _TARGETS_H
+#define _TARGETS_H
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include <immintrin.h>
+
+#include "io.h"
+
+// Header of a binary target index, as written by TargetTable::build_index().
+// It is followed by the bucket table, uint32_t buckets[2^prefix_bits + 1],
+// where entry p is the number of digests whose leading prefix_bits bits are
+// less than p, and then by the digests, sorted and without duplicates.
+struct TargetIndexHeader {
+  char magic[8];
+  uint32_t digest_size;
+  uint32_t prefix_bits;
+  uint64_t count;
+};
+
+const char TARGET_INDEX_MAGIC[8] = { 'C', 'R', 'H', 'I', 'D', 'X', '1', 0 };
+
+// A set of N-byte target digests to look up every hashed candidate in.
+//
+// A list read from text goes into an open addressing table with linear
+// probing over 8-byte slots keyed on the first digest word, which is
+// uniformly distributed already and needs no further hashing. The table is at
+// most half full, so a miss usually costs a single cache line.
+//
+// A binary index is mapped read-only instead, so that it loads instantly and
+// its pages are shared between processes. Its bucket table narrows a lookup
+// down to about four neighbouring digests.
+//
+// Up to SMALL_SIZE targets are also kept as a flat array of first words that
+// a whole batch is compared against with SIMD. Bigger lists get a prefilter,
+// a blocked Bloom filter that is much smaller than the table: the first
+// digest word of a target picks a 512-bit block, and six 9-bit pieces of the
+// next two words set bits in it. A candidate can only be a target if all its
+// bits are set, only then the table is probed. Every check thus touches a
+// single cache line, and at 16 bits per target about 0.1% of the candidates
+// get through.
+template <size_t N>
+class TargetTable {
+  typedef std::array<unsigned char, N> Digest;
+  static const size_t SMALL_SIZE = 16;
+  static_assert(N >= 12, "the prefilter takes three digest words");
+  static const int FILTER_BLOCK_BITS = 9; // log2 of the bits per block
+  static const int FILTER_HASHES = 6; // bits per target
+  static const int FILTER_BITS_PER_TARGET = 16; // by default
+
+  struct Slot {
+    uint32_t key; // first digest word
+    uint32_t idx; // 1 + number of the digest, 0 if empty
+  };
+
+  // Sorted digests, either owned or in the mapped index
+  std::vector<Digest> owned;
+  std::unique_ptr<MappedFile> mapped;
+  const Digest *digests;
+  size_t count;
+  // Bucket table of a mapped index
+  const uint32_t *buckets;
+  unsigned prefix_bits;
+  // Hash table of a list read from text
+  std::vector<Slot> slots;
+  size_t mask;
+  std::vector<uint32_t> small_keys;
+  // Prefilter, empty if unused
+  std::vector<uint64_t> filter;
+  uint32_t filter_mask; // number of blocks - 1
+
+  static uint32_t first_word(const unsigned char *digest) {
+    uint32_t w;
+    memcpy(&w, digest, 4);
+    return w;
+  }
+
+  // The leading bits of a digest, given its first word
+  static uint32_t prefix(uint32_t word, unsigned bits) {
+    return bits ? __builtin_bswap32(word) >> (32 - bits) : 0;
+  }
+
+  static int hex_value(char c) {
+    if (c >= '0' && c <= '9')
+      return c - '0';
+    if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+      return c - 'A' + 10;
+    return -1;
+  }
+
+  // Index of the first slot with the given key, or of the empty slot that
+  // ends its probe sequence
+  size_t probe(uint32_t key) const {
+    size_t i = key & mask;
+    while (slots[i].idx && slots[i].key != key)
+      i = (i + 1) & mask;
+    return i;
+  }
+
+  // Whether a digest in the bucket of word starts with word
+  bool bucket_has(uint32_t word) const {
+    uint32_t p = prefix(word, prefix_bits);
+    for (uint32_t k = buckets[p]; k < buckets[p + 1]; ++k) {
+      if (first_word(digests[k].data()) == word)
+        return true;
+    }
+    return false;
+  }
+
+  void build_slots() {
+    size_t cap = 2;
+    while (cap < 2 * count)
+      cap *= 2;
+    slots.assign(cap, Slot { 0, 0 });
+    mask = cap - 1;
+    for (size_t k = 0; k < count; ++k) {
+      uint32_t key = first_word(digests[k].data());
+      size_t i = key & mask;
+      while (slots[i].idx)
+        i = (i + 1) & mask;
+      slots[i] = Slot { key, (uint32_t)(k + 1) };
+    }
+  }
+
+  void build_small_keys() {
+    small_keys.clear();
+    if (count <= SMALL_SIZE) {
+      for (size_t k = 0; k < count; ++k)
+        small_keys.push_back(first_word(digests[k].data()));
+    }
+  }
+
+  // Bit h of the digest with the words w1 and w2 within its block
+  static uint32_t filter_bit(uint32_t w1, uint32_t w2, int h) {
+    return ((h < 3 ? w1 : w2) >> (FILTER_BLOCK_BITS * (h % 3))) & ((1 << FILTER_BLOCK_BITS) - 1);
+  }
+
+  // Whether the prefilter has the bits of the digest whose first words are
+  // word i of lane j at res[i * L + j]
+  template <size_t L>
+  bool filter_has(const uint32_t *res, size_t j) const {
+    const uint64_t *block = &filter[(size_t)(res[j] & filter_mask) << (FILTER_BLOCK_BITS - 6)];
+    for (int h = 0; h < FILTER_HASHES; ++h) {
+      uint32_t b = filter_bit(res[L + j], res[2 * L + j], h);
+      if (!(block[b >> 6] >> (b & 63) & 1))
+        return false;
+    }
+    return true;
+  }
+
+  // Reads one hex digest per line, sorted and without duplicates. Empty lines
+  // are skipped.
+  static std::vector<Digest> read_text(const std::string& fname) {
+    MappedFile f(fname);
+    const char *p = (const char*)f.data(), *end = p + f.size();
+    std::vector<Digest> list;
+    for (size_t nr = 1; p < end; ++nr) {
+      const char *eol = std::find(p, end, '\n'), *last = eol;
+      while (last > p && isspace((unsigned char)last[-1]))
+        --last;
+      if (last > p) {
+        Digest d;
+        bool ok = (size_t)(last - p) == 2 * N;
+        for (size_t i = 0; ok && i < N; ++i) {
+          int hi = hex_value(p[2 * i]), lo = hex_value(p[2 * i + 1]);
+          ok = hi >= 0 && lo >= 0;
+          d[i] = hi << 4 | lo;
+        }
+        if (!ok) {
+          throw IOException(fname + ":" + std::to_string(nr) + ": expected a hex digest of "
+                            + std::to_string(N) + " bytes");
+        }
+        list.push_back(d);
+      }
+      p = eol + 1;
+    }
+    std::sort(list.begin(), list.end());
+    list.erase(std::unique(list.begin(), list.end()), list.end());
+    if (list.size() >= UINT32_MAX)
+      throw IOException("Too many targets in " + fname);
+    return list;
+  }
+
+  // Writes the index of the count sorted digests to fname
+  static void write_index(const std::string& fname, const Digest *digests, size_t count) {
+    TargetIndexHeader h;
+    memcpy(h.magic, TARGET_INDEX_MAGIC, 8);
+    h.digest_size = N;
+    h.count = count;
+    // About four digests per bucket
+    h.prefix_bits = 1;
+    while (h.prefix_bits < 28 && (uint64_t(4) << h.prefix_bits) < count)
+      h.prefix_bits++;
+    std::vector<uint32_t> table((size_t(1) << h.prefix_bits) + 1);
+    size_t k = 0;
+    for (size_t p = 0; p < table.size(); ++p) {
+      while (k < count && prefix(first_word(digests[k].data()), h.prefix_bits) < p)
+        ++k;
+      table[p] = k;
+    }
+    std::ofstream f(fname, std::ios::binary | std::ios::trunc);
+    f.write((const char*)&h, sizeof(h));
+    f.write((const char*)table.data(), table.size() * sizeof(uint32_t));
+    f.write((const char*)digests, count * N);
+    f.close();
+    if (!f.good())
+      throw IOException("Could not write file " + fname);
+  }
+
+public:
+  TargetTable()
+    : digests(nullptr), count(0), buckets(nullptr), prefix_bits(0), mask(0), filter_mask(0) {}
+
+  // Builds the prefilter with 2^bits bits. With bits < 0 the size is picked
+  // from the number of targets, 0 disables the prefilter. Lists of up to
+  // SMALL_SIZE targets never use it.
+  void build_prefilter(int bits) {
+    if (bits < 0) {
+      bits = FILTER_BLOCK_BITS;
+      while (bits < 32 && (uint64_t(1) << bits) < (uint64_t)FILTER_BITS_PER_TARGET * count)
+        bits++;
+    }
+    filter.clear();
+    if (bits == 0 || count <= SMALL_SIZE)
+      return;
+    bits = std::max(bits, FILTER_BLOCK_BITS);
+    filter.assign((size_t(1) << bits) / 64, 0);
+    filter_mask = (uint32_t)((uint64_t(1) << (bits - FILTER_BLOCK_BITS)) - 1);
+    for (size_t k = 0; k < count; ++k) {
+      uint32_t w[3];
+      memcpy(w, digests[k].data(), sizeof(w));
+      uint64_t *block = &filter[(size_t)(w[0] & filter_mask) << (FILTER_BLOCK_BITS - 6)];
+      for (int h = 0; h < FILTER_HASHES; ++h) {
+        uint32_t b = filter_bit(w[1], w[2], h);
+        block[b >> 6] |= uint64_t(1) << (b & 63);
+      }
+    }
+  }
+
+  // Total size of the prefilter in bytes
+  size_t prefilter_size() const {
+    return filter.size() * sizeof(uint64_t);
+  }
+
+  // Expected share of the candidates that get through the prefilter
+  double prefilter_rate() const {
+    double bits = filter.size() * 64.0;
+    return std::pow(1 - std::exp(-FILTER_HASHES * (double)count / bits), FILTER_HASHES);
+  }
+
+  // Reads one hex digest per line. Empty lines are skipped.
+  void load_text(const std::string& fname) {
+    std::vector<Digest> list = read_text(fname);
+    owned.swap(list);
+    mapped.reset();
+    digests = owned.data();
+    count = owned.size();
+    buckets = nullptr;
+    prefix_bits = 0;
+    build_slots();
+    build_small_keys();
+  }
+
+  // Maps an index written by build_index()
+  void load_index(const std::string& fname) {
+    std::unique_ptr<MappedFile> f(new MappedFile(fname));
+    TargetIndexHeader h;
+    if (f->size() < sizeof(h))
+      throw IOException("Invalid target index " + fname);
+    memcpy(&h, f->data(), sizeof(h));
+    if (memcmp(h.magic, TARGET_INDEX_MAGIC, 8) != 0 || h.prefix_bits > 28)
+      throw IOException("Invalid target index " + fname);
+    if (h.digest_size != N)
+      throw IOException("Target index " + fname + " holds digests of another size");
+    size_t table = sizeof(h) + ((size_t(1) << h.prefix_bits) + 1) * sizeof(uint32_t);
+    if (h.count >= UINT32_MAX || f->size() != table + h.count * N)
+      throw IOException("Invalid target index " + fname);
+    // Lookups trust the buckets to lie within the digests
+    const uint32_t *b = (const uint32_t*)(f->data() + sizeof(h));
+    size_t num_buckets = size_t(1) << h.prefix_bits;
+    if (b[0] != 0 || b[num_buckets] != h.count)
+      throw IOException("Invalid target index " + fname);
+    for (size_t p = 0; p < num_buckets; ++p) {
+      if (b[p] > b[p + 1])
+        throw IOException("Invalid target index " + fname);
+    }
+    owned.clear();
+    slots.clear();
+    buckets = b;
+    digests = (const Digest*)(f->data() + table);
+    count = h.count;
+    prefix_bits = h.prefix_bits;
+    mapped = std::move(f);
+    build_small_keys();
+  }
+
+  // Loads fname as an index if it starts with the index magic, else as text
+  void load(const std::string& fname) {
+    bool is_index;
+    {
+      MappedFile f(fname);
+      is_index = f.size() >= 8 && memcmp(f.data(), TARGET_INDEX_MAGIC, 8) == 0;
+    }
+    if (is_index)
+      load_index(fname);
+    else
+      load_text(fname);
+  }
+
+  // Writes an index of the hex digests in the text file in to out, without
+  // building any lookup tables. Returns the number of digests.
+  static size_t build_index(const std::string& in, const std::string& out) {
+    std::vector<Digest> list = read_text(in);
+    write_index(out, list.data(), list.size());
+    return list.size();
+  }
+
+  size_t size() const {
+    return count;
+  }
+
+  bool empty() const {
+    return !count;
+  }
+
+  bool contains(const unsigned char *digest) const {
+    if (empty())
+      return false;
+    uint32_t key = first_word(digest);
+    if (buckets) {
+      uint32_t p = prefix(key, prefix_bits);
+      for (uint32_t k = buckets[p]; k < buckets[p + 1]; ++k) {
+        if (memcmp(digests[k].data(), digest, N) == 0)
+          return true;
+      }
+      return false;
+    }
+    for (size_t i = probe(key); slots[i].idx && slots[i].key == key; i = (i + 1) & mask) {
+      if (memcmp(digests[slots[i].idx - 1].data(), digest, N) == 0)
+        return true;
+    }
+    return false;
+  }
+
+  // Batch version of contains() over L digests in the SoA layout of the batch
+  // hash kernels: word i of lane j at res[i * L + j]. Returns a bitmask of the
+  // lanes that hold a target.
+  template <size_t L>
+  uint64_t match_batch(const uint32_t *res) const {
+    uint64_t hits = 0;
+    if (empty())
+      return 0;
+    if (!small_keys.empty()) {
+      size_t j = 0;
+#if defined(__AVX512F__)
+      for (; j + 16 <= L; j += 16) {
+        __m512i w = _mm512_loadu_si512((const __m512i *)(res + j));
+        __mmask16 m = 0;
+        for (uint32_t key : small_keys)
+          m |= _mm512_cmpeq_epi32_mask(w, _mm512_set1_epi32(key));
+        hits |= (uint64_t)m << j;
+      }
+#endif
+#if defined(__AVX2__)
+      for (; j + 8 <= L; j += 8) {
+        __m256i w = _mm256_loadu_si256((const __m256i *)(res + j));
+        __m256i m = _mm256_setzero_si256();
+        for (uint32_t key : small_keys)
+          m = _mm256_or_si256(m, _mm256_cmpeq_epi32(w, _mm256_set1_epi32(key)));
+        hits |= (uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(m)) << j;
+      }
+#endif
+      for (; j < L; ++j) {
+        if (std::find(small_keys.begin(), small_keys.end(), res[j]) != small_keys.end())
+          hits |= uint64_t(1) << j;
+      }
+    } else {
+      uint64_t cand = (L < 64 ? (uint64_t(1) << L) - 1 : ~uint64_t(0));
+      if (!filter.empty()) {
+        cand = 0;
+        for (size_t j = 0; j < L; ++j)
+          cand |= (uint64_t)filter_has<L>(res, j) << j;
+      }
+      // Issue the loads of all lanes before waiting for any of them
+      if (buckets) {
+        for (uint64_t m = cand; m; m &= m - 1)
+          __builtin_prefetch(&buckets[prefix(res[__builtin_ctzll(m)], prefix_bits)]);
+        for (uint64_t m = cand; m; m &= m - 1) {
+          int j = __builtin_ctzll(m);
+          if (bucket_has(res[j]))
+            hits |= uint64_t(1) << j;
+        }
+      } else {
+        for (uint64_t m = cand; m; m &= m - 1)
+          __builtin_prefetch(&slots[res[__builtin_ctzll(m)] & mask]);
+        for (uint64_t m = cand; m; m &= m - 1) {
+          int j = __builtin_ctzll(m);
+          if (slots[probe(res[j])].idx)
+            hits |= uint64_t(1) << j;
+        }
+      }
+    }
+    // Only the first word matched so far
+    for (uint64_t m = hits; m; m &= m - 1) {
+      int j = __builtin_ctzll(m);
+      unsigned char digest[N];
+      for (size_t i = 0; i < N / 4; ++i)
+        memcpy(digest + 4 * i, &res[i * L + j], 4);
+      if (!contains(digest))
+        hits &= ~(uint64_t(1) << j);
+    }
+    return hits;
+  }
+
+  uint64_t fingerprint() const {
+    return fnv1a(FNV_BASIS, digests, count * sizeof(Digest));
+  }
+};
+
+#endif
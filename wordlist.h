@@ -0,0 +1,97 @@
+#ifndef _WORDLIST_H
+#define _WORDLIST_H
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <cstdint>
+#include <cstring>
+
+#include "index.h"
+#include "io.h"
+
+// A list of words, one per line, mapped read-only. Word i is line i without
+// its "\n" or "\r\n" terminator, so the words are numbered like the
+// candidates of a keyspace and can be split into ranges the same way. Every
+// STRIDE-th line start is recorded when the list is loaded, so any word is
+// found by skipping fewer than STRIDE lines, without copying the file.
+class Wordlist {
+  static const size_t STRIDE = 1024;
+
+  std::unique_ptr<MappedFile> file;
+  std::vector<size_t> marks; // offset of every STRIDE-th word
+  index_t count;
+  size_t longest;
+
+  const char *data() const {
+    return (const char*)file->data();
+  }
+
+public:
+  Wordlist() : count(0), longest(0) {}
+
+  void load(const std::string& fname) {
+    file.reset(new MappedFile(fname));
+    marks.clear();
+    count = 0;
+    longest = 0;
+    const char *p = data(), *end = p + file->size();
+    while (p < end) {
+      if (count % STRIDE == 0)
+        marks.push_back(p - data());
+      const char *word;
+      size_t len;
+      next(p, end, word, len);
+      longest = std::max(longest, len);
+      count++;
+    }
+  }
+
+  index_t size() const {
+    return count;
+  }
+
+  // Length of the longest word
+  size_t max_length() const {
+    return longest;
+  }
+
+  const char *begin() const {
+    return data();
+  }
+
+  const char *end() const {
+    return data() + file->size();
+  }
+
+  uint64_t fingerprint() const {
+    return fnv1a(FNV_BASIS, data(), file->size());
+  }
+
+  // Start of word index
+  const char *seek(index_t index) const {
+    if (index >= count)
+      return end();
+    const char *p = data() + marks[index / STRIDE], *word;
+    size_t len;
+    for (size_t i = index % STRIDE; i > 0; --i)
+      next(p, end(), word, len);
+    return p;
+  }
+
+  // Reads the word at p, which must be before end, and advances p to the next
+  static void next(const char *&p, const char *end, const char *&word, size_t& len) {
+    const char *eol = (const char*)memchr(p, '\n', end - p);
+    if (!eol)
+      eol = end;
+    word = p;
+    len = eol - p;
+    if (len && word[len - 1] == '\r')
+      len--;
+    p = eol < end ? eol + 1 : end;
+  }
+};
+
+#endif